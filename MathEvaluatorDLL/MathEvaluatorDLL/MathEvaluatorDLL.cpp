@@ -4,10 +4,47 @@
 #include "exports.h"
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 
 #include "math/mathevaluator.h"
 
-std::map<int, MathExpressions::State> g_mStates;
+// Handle of the numeric interface
+struct MathEvaluatorExpression
+{
+	MathExpressions::CompiledExpression expression;
+};
+
+// A state can only be used by one thread at a time
+struct StateEntry
+{
+	std::mutex mutex;
+	MathExpressions::State state;
+};
+
+// Entries are shared with the evaluations using them, a released state is destroyed after the last one
+std::map<int, std::shared_ptr<StateEntry>> g_mStates;
+std::shared_mutex g_statesMutex;
+
+// Creates the state on first use
+static std::shared_ptr<StateEntry> GetState(int id)
+{
+	{
+		std::shared_lock<std::shared_mutex> lock(g_statesMutex);
+
+		auto it = g_mStates.find(id);
+		if (it != g_mStates.end())
+			return it->second;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(g_statesMutex);
+	std::shared_ptr<StateEntry> &entry = g_mStates[id];
+	if (entry == nullptr)
+		entry = std::make_shared<StateEntry>();
+
+	return entry;
+}
 
 int evaluate(const char *expression, char *result, int length)
 {
@@ -21,14 +58,21 @@ int evaluate(const char *expression, char *result, int length)
 	}
 
 	if (length > 0)
-		strncpy_s(result, length, res.GetString().c_str(), _TRUNCATE);
+		res.GetString(result, static_cast<std::size_t>(length));
 
 	return 1;
 }
 
 int evaluate_state(const char *expression, char *result, int length, int id)
 {
-	MathExpressions::Result res = g_mStates[id].Evaluate(expression);
+	std::shared_ptr<StateEntry> entry = GetState(id);
+
+	MathExpressions::Result res;
+	{
+		std::lock_guard<std::mutex> lock(entry->mutex);
+		res = entry->state.Evaluate(expression);
+	}
+
 	if (res.Error())
 	{
 		if (length > 0)
@@ -38,7 +82,94 @@ int evaluate_state(const char *expression, char *result, int length, int id)
 	}
 
 	if (length > 0)
-		strncpy_s(result, length, res.GetString().c_str(), _TRUNCATE);
+		res.GetString(result, static_cast<std::size_t>(length));
 
 	return 1;
+}
+
+void release_state(int id)
+{
+	std::shared_ptr<StateEntry> entry;
+	{
+		std::unique_lock<std::shared_mutex> lock(g_statesMutex);
+
+		auto it = g_mStates.find(id);
+		if (it == g_mStates.end())
+			return;
+
+		entry = std::move(it->second);
+		g_mStates.erase(it);
+	}
+
+	// Destroyed outside of the lock if no evaluation is using it
+}
+
+void set_cache_capacity(int capacity)
+{
+	MathExpressions::GetExpressionCache().SetCapacity(capacity > 0 ? static_cast<std::size_t>(capacity) : 0u);
+}
+
+// Reports the error code of the result
+static double GetValue(MathExpressions::Result &res, int *error)
+{
+	if (error != nullptr)
+		*error = res.Error() ? MATHEVALUATOR_ERROR : MATHEVALUATOR_OK;
+
+	return res.Get<double>();
+}
+
+double evaluate_value(const char *expression, size_t length, int *error)
+{
+	MathExpressions::Result res = MathExpressions::Evaluate(std::string_view(expression, length));
+	return GetValue(res, error);
+}
+
+double evaluate_value_state(const char *expression, size_t length, int id, int *error)
+{
+	std::shared_ptr<StateEntry> entry = GetState(id);
+
+	MathExpressions::Result res;
+	{
+		std::lock_guard<std::mutex> lock(entry->mutex);
+		res = entry->state.Evaluate(std::string_view(expression, length));
+	}
+
+	return GetValue(res, error);
+}
+
+MathEvaluatorExpression *compile_expression(const char *expression, size_t length)
+{
+	MathExpressions::CompiledExpression compiled = MathExpressions::GetExpressionCache().Get(std::string_view(expression, length));
+	if (compiled.Error())
+		return nullptr;
+
+	return new MathEvaluatorExpression{ compiled };
+}
+
+double evaluate_expression(const MathEvaluatorExpression *handle, int *error)
+{
+	MathExpressions::Result res;
+	if (handle != nullptr)
+		res = handle->expression.Evaluate();
+
+	return GetValue(res, error);
+}
+
+double evaluate_expression_state(const MathEvaluatorExpression *handle, int id, int *error)
+{
+	MathExpressions::Result res;
+	if (handle != nullptr)
+	{
+		std::shared_ptr<StateEntry> entry = GetState(id);
+
+		std::lock_guard<std::mutex> lock(entry->mutex);
+		res = entry->state.Evaluate(handle->expression);
+	}
+
+	return GetValue(res, error);
+}
+
+void release_expression(MathEvaluatorExpression *handle)
+{
+	delete handle;
 }
\ No newline at end of file
@@ -1,11 +1,63 @@
 #pragma once
 
+#include <stddef.h>
+
+#if defined(_WIN32)
 #ifdef MATHEVALUATORDLL_EXPORTS
 #define MATHEVALUATOR_API __declspec(dllexport)
 #else
 #define MATHEVALUATOR_API __declspec(dllimport)
 #endif
+#elif defined(__GNUC__)
+// Everything else is hidden when built with -fvisibility=hidden
+#define MATHEVALUATOR_API __attribute__((visibility("default")))
+#else
+#define MATHEVALUATOR_API
+#endif
+
+// Usable from C, the functions have C linkage
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MATHEVALUATOR_API int evaluate(const char *expression, char *result, int length);
+
+MATHEVALUATOR_API int evaluate_state(const char *expression, char *result, int length, int id);
+
+// Removes the variables and functions of the state, the id starts over with an empty state
+// Evaluations with the state that are still running finish first
+MATHEVALUATOR_API void release_state(int id);
+
+
+// Number of compiled expressions kept between calls, 0 disables caching
+MATHEVALUATOR_API void set_cache_capacity(int capacity);
+
+/* Numeric interface, no formatting of the result */
+
+// Error codes of the numeric interface
+#define MATHEVALUATOR_OK 0
+// Malformed expression, undefined variable or invalid handle
+#define MATHEVALUATOR_ERROR 1
+
+// Evaluates length characters of the expression, which does not have to be null-terminated
+// Stores an error code in error if it is not null, the result is 0 on error
+MATHEVALUATOR_API double evaluate_value(const char *expression, size_t length, int *error);
+
+MATHEVALUATOR_API double evaluate_value_state(const char *expression, size_t length, int id, int *error);
+
+// Compiled expression, can be evaluated any number of times without parsing it again
+typedef struct MathEvaluatorExpression MathEvaluatorExpression;
+
+// Returns null if the expression is malformed
+// The handle has to be released with release_expression()
+MATHEVALUATOR_API MathEvaluatorExpression *compile_expression(const char *expression, size_t length);
+
+MATHEVALUATOR_API double evaluate_expression(const MathEvaluatorExpression *handle, int *error);
+
+MATHEVALUATOR_API double evaluate_expression_state(const MathEvaluatorExpression *handle, int id, int *error);
 
-extern "C" MATHEVALUATOR_API int evaluate(const char *expression, char *result, int length);
+MATHEVALUATOR_API void release_expression(MathEvaluatorExpression *handle);
 
-extern "C" MATHEVALUATOR_API int evaluate_state(const char *expression, char *result, int length, int id);
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,458 @@
+// benchmark.cpp : Microbenchmarks of the parse, evaluate and end-to-end paths
+//
+// Usage: MathEvaluatorBenchmark [--filter <substring>] [--min-time <seconds>] [--csv]
+// Every benchmark is repeated and the median is reported, so runs of different commits can be compared
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "exports.h"
+#include "math/mathevaluator.h"
+
+/* Allocation counting */
+
+static std::atomic<std::size_t> g_nAllocations(0);
+
+void *operator new(std::size_t size)
+{
+	g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	void *memory = std::malloc(size != 0 ? size : 1);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+
+	return memory;
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+/* Corpus */
+
+// Expressions of the kind submitted by users, variables are x, y and z
+static const std::vector<std::string> g_vCorpus =
+{
+	"2 + 2",
+	"2*pi/360*x",
+	"sqrt(2)*y",
+	"x*x + y*y",
+	"sqrt(x^2 + y^2 + z^2)",
+	"sin(x)*cos(y) + cos(x)*sin(y)",
+	"(x + 1)*(x - 1)/(x*x + 1)",
+	"e^(-x*x/2)/sqrt(2*pi)",
+	"max(x, y) - min(y, z)",
+	"abs(x - y) + round(z*100)/100",
+	"log(2, 1024) + ln(e^3)",
+	"floor(x/3)*3 + x % 3",
+	"-(x + y)*-(z - 1)",
+	"1.5*x^3 - 2.25*x^2 + 0.5*x - 7",
+	"(sin(x)^2 + cos(x)^2)*y",
+	"10 mod 4 + 17 % 5",
+	"exp(ln(x + 10))",
+	"((((x + 1)*2 + 3)*4 + 5)*6 + 7)",
+	"phi^2 - phi - 1",
+	"randf(0, 1)*x + rand(1, 6)"
+};
+
+// Every expression of the corpus has to compile, errors would be measured instead of evaluation
+static bool CheckCorpus()
+{
+	bool bValid = true;
+	for (const std::string &expression : g_vCorpus)
+	{
+		if (MathExpressions::Compile(expression).Error())
+		{
+			std::fprintf(stderr, "Malformed expression in the corpus: %s\n", expression.c_str());
+			bValid = false;
+		}
+	}
+
+	return bValid;
+}
+
+/* Harness */
+
+struct Measurement
+{
+	double nanoseconds;
+	double allocations;
+};
+
+struct Options
+{
+	std::string filter;
+	double minTime = 0.2;
+	bool csv = false;
+};
+
+static Options g_options;
+
+// Runs the body, which performs operations per call, until the minimal time has passed
+// Repeated five times, the median is reported
+static void Run(const char *name, std::size_t operations, const std::function<void()> &body)
+{
+	if (!g_options.filter.empty() && std::strstr(name, g_options.filter.c_str()) == nullptr)
+		return;
+
+	using Clock = std::chrono::steady_clock;
+
+	// Warm up caches and find the number of calls per repetition
+	std::size_t calls = 1;
+	for (;;)
+	{
+		Clock::time_point start = Clock::now();
+		for (std::size_t i = 0; i < calls; i++)
+			body();
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+		if (elapsed >= g_options.minTime / 5 || calls >= (1u << 30))
+			break;
+
+		calls *= 2;
+	}
+
+	std::vector<Measurement> measurements;
+	for (int repetition = 0; repetition < 5; repetition++)
+	{
+		std::size_t allocations = g_nAllocations.load(std::memory_order_relaxed);
+		Clock::time_point start = Clock::now();
+
+		for (std::size_t i = 0; i < calls; i++)
+			body();
+
+		double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		allocations = g_nAllocations.load(std::memory_order_relaxed) - allocations;
+
+		const double count = static_cast<double>(calls * operations);
+		measurements.push_back({ elapsed / count, allocations / count });
+	}
+
+	std::sort(measurements.begin(), measurements.end(), [](const Measurement &a, const Measurement &b)
+	{
+		return a.nanoseconds < b.nanoseconds;
+	});
+	const Measurement &median = measurements[measurements.size() / 2];
+
+	if (g_options.csv)
+		std::printf("%s,%.2f,%.3f,%.0f\n", name, median.nanoseconds, median.allocations, 1e9 / median.nanoseconds);
+	else
+		std::printf("%-36s %12.2f ns %10.3f allocs %14.0f ops/s\n", name, median.nanoseconds, median.allocations, 1e9 / median.nanoseconds);
+}
+
+// Keeps the optimizer from removing the benchmarked work
+static volatile double g_sink;
+
+// Identifiers cannot contain digits, names are spelled with letters
+static std::string MakeName(const char *prefix, std::size_t index)
+{
+	std::string name = prefix;
+	for (std::size_t n = index; ; n /= 26)
+	{
+		name += static_cast<char>('a' + n % 26);
+		if (n < 26)
+			break;
+	}
+
+	return name;
+}
+
+/* Benchmarks */
+
+static void BenchmarkParse()
+{
+	Run("parse/corpus", g_vCorpus.size(), []()
+	{
+		for (const std::string &expression : g_vCorpus)
+			g_sink = MathExpressions::Compile(expression).Error();
+	});
+}
+
+static void BenchmarkEvaluate()
+{
+	MathInternals::State state;
+	state.Set("x", 1.25);
+	state.Set("y", -0.5);
+	state.Set("z", 3.0);
+
+	std::vector<MathExpressions::CompiledExpression> compiled;
+	for (const std::string &expression : g_vCorpus)
+		compiled.push_back(MathExpressions::Compile(expression));
+
+	Run("evaluate/interpreter", compiled.size(), [&]()
+	{
+		for (const MathExpressions::CompiledExpression &expression : compiled)
+			g_sink = expression.Evaluate(&state).Get();
+	});
+
+	std::vector<MathExpressions::JitExpression> native(compiled.begin(), compiled.end());
+	Run("evaluate/jit", native.size(), [&]()
+	{
+		for (const MathExpressions::JitExpression &expression : native)
+			g_sink = expression.Evaluate(&state).Get();
+	});
+
+	// Variables read from slots instead of the state
+	std::vector<MathExpressions::CompiledExpression> bound = compiled;
+	double x = 1.25, y = -0.5, z = 3.0;
+	for (MathExpressions::CompiledExpression &expression : bound)
+	{
+		expression.Bind("x", &x);
+		expression.Bind("y", &y);
+		expression.Bind("z", &z);
+	}
+	Run("evaluate/bound", bound.size(), [&]()
+	{
+		for (const MathExpressions::CompiledExpression &expression : bound)
+			g_sink = expression.Evaluate().Get();
+	});
+}
+
+static void BenchmarkEndToEnd()
+{
+	MathInternals::State state;
+	state.Set("x", 1.25);
+	state.Set("y", -0.5);
+	state.Set("z", 3.0);
+
+	MathExpressions::ExpressionCache &cache = MathExpressions::GetExpressionCache();
+	const std::size_t capacity = cache.GetCapacity();
+
+	Run("end-to-end/cached", g_vCorpus.size(), [&]()
+	{
+		for (const std::string &expression : g_vCorpus)
+			g_sink = MathExpressions::Evaluate(expression, &state).Get();
+	});
+
+	cache.SetCapacity(0);
+	Run("end-to-end/uncached", g_vCorpus.size(), [&]()
+	{
+		for (const std::string &expression : g_vCorpus)
+			g_sink = MathExpressions::Evaluate(expression, &state).Get();
+	});
+	cache.SetCapacity(capacity);
+
+	Run("end-to-end/format", g_vCorpus.size(), [&]()
+	{
+		for (const std::string &expression : g_vCorpus)
+			g_sink = static_cast<double>(MathExpressions::Evaluate(expression, &state).GetString().size());
+	});
+
+	char buffer[64];
+	Run("end-to-end/format-buffer", g_vCorpus.size(), [&]()
+	{
+		for (const std::string &expression : g_vCorpus)
+			g_sink = static_cast<double>(MathExpressions::Evaluate(expression, &state).GetString(buffer, sizeof(buffer)));
+	});
+}
+
+static void BenchmarkState()
+{
+	for (std::size_t count : { 10u, 100u, 10000u })
+	{
+		std::vector<std::string> names;
+		for (std::size_t i = 0; i < count; i++)
+			names.push_back(MakeName("v", i));
+
+		MathInternals::State state;
+		for (std::size_t i = 0; i < count; i++)
+			state.Set(names[i], static_cast<double>(i));
+
+		// Same number of lookups for every size
+		std::vector<std::string> lookups;
+		for (std::size_t i = 0; i < 64u; i++)
+			lookups.push_back(names[(i * 7919u) % count]);
+
+		std::string name = "state/find/" + std::to_string(count);
+		Run(name.c_str(), lookups.size(), [&]()
+		{
+			for (const std::string &lookup : lookups)
+				g_sink = state.GetValue(state.Find(lookup));
+		});
+
+		std::vector<MathExpressions::CompiledExpression> compiled;
+		for (std::size_t i = 0; i < 8u; i++)
+			compiled.push_back(MathExpressions::Compile(lookups[i] + " + " + lookups[i + 8u] + "*2"));
+
+		name = "state/evaluate/" + std::to_string(count);
+		Run(name.c_str(), compiled.size(), [&]()
+		{
+			for (const MathExpressions::CompiledExpression &expression : compiled)
+				g_sink = expression.Evaluate(&state).Get();
+		});
+	}
+}
+
+static void BenchmarkExports()
+{
+	evaluate_state("x = 1.25", nullptr, 0, 0);
+	evaluate_state("y = -0.5", nullptr, 0, 0);
+	evaluate_state("z = 3", nullptr, 0, 0);
+
+	char result[64];
+	Run("dll/evaluate_state", g_vCorpus.size(), [&]()
+	{
+		for (const std::string &expression : g_vCorpus)
+			g_sink = evaluate_state(expression.c_str(), result, sizeof(result), 0);
+	});
+
+	Run("dll/evaluate_value_state", g_vCorpus.size(), [&]()
+	{
+		int error;
+		for (const std::string &expression : g_vCorpus)
+			g_sink = evaluate_value_state(expression.data(), expression.size(), 0, &error);
+	});
+}
+
+static void BenchmarkBatch()
+{
+	const std::size_t rows = 1u << 16;
+
+	std::vector<double> x(rows), y(rows), output(rows);
+	for (std::size_t i = 0; i < rows; i++)
+	{
+		x[i] = static_cast<double>(i) / rows;
+		y[i] = 1.0 - x[i];
+	}
+
+	const std::vector<MathExpressions::Column> columns = { { "x", x.data() }, { "y", y.data() } };
+
+	for (const char *expression : { "x*x + y*y", "sqrt(x^2 + y^2)", "sin(x)*cos(y) + cos(x)*sin(y)" })
+	{
+		MathExpressions::CompiledExpression compiled = MathExpressions::Compile(expression);
+
+		std::string name = std::string("batch/") + expression;
+		Run(name.c_str(), rows, [&]()
+		{
+			g_sink = MathExpressions::EvaluateBatch(compiled, columns, rows, output.data());
+		});
+	}
+
+	// Larger inputs for the threads, the default chunk size
+	const std::size_t parallelRows = 1u << 20;
+
+	std::vector<double> px(parallelRows), py(parallelRows), poutput(parallelRows);
+	for (std::size_t i = 0; i < parallelRows; i++)
+	{
+		px[i] = static_cast<double>(i) / parallelRows;
+		py[i] = 1.0 - px[i];
+	}
+
+	const std::vector<MathExpressions::Column> parallelColumns = { { "x", px.data() }, { "y", py.data() } };
+	MathExpressions::CompiledExpression compiled = MathExpressions::Compile("sin(x)*cos(y) + cos(x)*sin(y)");
+
+	for (std::size_t threads : { 1u, 2u, 4u, 8u, 16u, 32u })
+	{
+		MathExpressions::BatchSchedule schedule;
+		schedule.threads = threads;
+
+		std::string name = "batch-parallel/" + std::to_string(threads);
+		Run(name.c_str(), parallelRows, [&]()
+		{
+			g_sink = MathExpressions::EvaluateBatchParallel(compiled, parallelColumns, parallelRows, poutput.data(), schedule);
+		});
+	}
+}
+
+static void BenchmarkReactive()
+{
+	// Two layers of formulas over a single input, every formula is recomputed when it changes
+	const std::size_t width = 4096u;
+
+	MathInternals::State state;
+	state.SetReactive(true);
+	const MathInternals::State::Slot input = state.Set("input", 1.0);
+
+	for (std::size_t i = 0; i < width; i++)
+		MathExpressions::Evaluate(MakeName("f", i) + " = sqrt(input*" + std::to_string(i + 1u) + ") + sin(input)", &state);
+	for (std::size_t i = 0; i < width; i++)
+		MathExpressions::Evaluate(MakeName("g", i) + " = " + MakeName("f", i) + "*" + MakeName("f", (i * 7u) % width) + " - cos(input)", &state);
+
+	// Results have to be the same for every number of threads
+	std::vector<double> expected;
+	for (std::size_t threads : { 1u, 2u, 4u, 8u, 16u, 32u })
+	{
+		state.SetThreads(threads);
+		state.SetValue(input, 2.0);
+
+		std::vector<double> values;
+		for (MathInternals::State::Slot slot = 0; slot < state.Size(); slot++)
+			values.push_back(state.GetValue(slot));
+
+		if (expected.empty())
+			expected = values;
+		else if (values != expected)
+			std::fprintf(stderr, "reactive: results with %zu threads differ\n", threads);
+
+		double value = 1.0;
+		std::string name = "reactive/recompute/" + std::to_string(threads);
+		Run(name.c_str(), 2u * width, [&]()
+		{
+			value = value == 1.0 ? 2.0 : 1.0;
+			state.SetValue(input, value);
+		});
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			g_options.filter = argv[++i];
+		else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+			g_options.minTime = std::atof(argv[++i]);
+		else if (std::strcmp(argv[i], "--csv") == 0)
+			g_options.csv = true;
+		else
+		{
+			std::fprintf(stderr, "Usage: %s [--filter <substring>] [--min-time <seconds>] [--csv]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!CheckCorpus())
+		return 1;
+
+	if (g_options.csv)
+		std::printf("benchmark,ns_per_op,allocs_per_op,ops_per_second\n");
+
+	BenchmarkParse();
+	BenchmarkEvaluate();
+	BenchmarkEndToEnd();
+	BenchmarkState();
+	BenchmarkExports();
+	BenchmarkBatch();
+	BenchmarkReactive();
+
+	return 0;
+}
\ No newline at end of file
@@ -1,9 +1,105 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "math/mathevaluator.h"
+#include "math/threadpool.h"
+
+// Size of a single read of the input, lines longer than that make the buffer grow
+constexpr std::size_t ReadSize = 1u << 20;
+
+// Output is written once this much of it has been collected
+constexpr std::size_t WriteSize = 1u << 20;
+
+// Lines evaluated by a thread at once in the multithreaded batch mode
+constexpr std::size_t ChunkLines = 256u;
+
+static int printUsage(const char *program);
+static bool parseCount(const char *text, std::size_t &count);
+static int runInteractive();
+static int runBatch(const char *path, std::size_t threads);
+static void evaluateParallel(MathExpressions::State &state, const std::vector<std::string_view> &lines, std::size_t first, std::size_t last, std::size_t threads, std::vector<std::string> &chunks, std::string &output);
+static void appendResult(std::string &output, const MathExpressions::Result &res);
+static void writeOutput(std::string &output);
 
 int main(int argc, char *argv[])
+{
+	bool batch = false;
+	bool threadsGiven = false;
+	const char *path = nullptr;
+	std::size_t threads = 1u;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--batch") == 0)
+		{
+			batch = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			if (!parseCount(argv[++i], threads))
+			{
+				std::cerr << "Invalid number of threads: " << argv[i] << std::endl;
+				return printUsage(argv[0]);
+			}
+
+			threadsGiven = true;
+		}
+		else
+		{
+			return printUsage(argv[0]);
+		}
+	}
+
+	// The interactive mode evaluates one line at a time
+	if (threadsGiven && !batch)
+	{
+		std::cerr << "--threads requires --batch" << std::endl;
+		return printUsage(argv[0]);
+	}
+
+	if (batch)
+		return runBatch(path, threads);
+
+	return runInteractive();
+}
+
+static int printUsage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [--batch [file] [--threads <count>]]" << std::endl;
+	std::cerr << "  --batch    Evaluates every line of the file or the standard input, writes one result per line" << std::endl;
+	std::cerr << "  --threads  Evaluates runs of lines without assignments and definitions on several threads" << std::endl;
+	std::cerr << "             0 for every hardware thread, the output is the same for any number of threads" << std::endl;
+	return 1;
+}
+
+// Accepts decimal digits only, strtoul() would take signs and whitespace and turn garbage into 0
+static bool parseCount(const char *text, std::size_t &count)
+{
+	if (*text < '0' || *text > '9')
+		return false;
+
+	char *end;
+	errno = 0;
+	const unsigned long value = std::strtoul(text, &end, 10);
+	if (*end != '\0' || errno == ERANGE)
+		return false;
+
+	count = static_cast<std::size_t>(value);
+	return true;
+}
+
+static int runInteractive()
 {
 	MathExpressions::State state;
 
@@ -25,4 +121,173 @@ int main(int argc, char *argv[])
 	}
 
 	return 0;
+}
+
+// Reads the input in large blocks and evaluates the complete lines of every block
+// The state is shared by all of the lines, lines assigning variables or defining functions are evaluated in order
+// Lines per second are reported to the standard error in the end
+static int runBatch(const char *path, std::size_t threads)
+{
+	std::FILE *input = path != nullptr ? std::fopen(path, "rb") : stdin;
+	if (input == nullptr)
+	{
+		std::cerr << "Cannot open " << path << std::endl;
+		return 1;
+	}
+
+	if (threads == 0u)
+		threads = MathInternals::ThreadPool::GetHardwareThreads();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	MathExpressions::State state;
+	std::size_t numLines = 0;
+
+	std::vector<char> buffer(ReadSize);
+	std::size_t used = 0;
+
+	std::string output;
+	output.reserve(WriteSize + 64u);
+
+	std::vector<std::string_view> lines;
+	std::vector<std::string> chunks;
+
+	bool end = false;
+	while (!end)
+	{
+		// Lines longer than the buffer make it grow
+		if (buffer.size() - used < ReadSize / 2)
+			buffer.resize(buffer.size() * 2);
+
+		std::size_t read = std::fread(buffer.data() + used, 1, buffer.size() - used, input);
+		used += read;
+		end = read == 0;
+
+		// Lines are evaluated once they are complete, the last line does not need a line break
+		std::size_t complete = used;
+		if (!end)
+		{
+			while (complete > 0 && buffer[complete - 1u] != '\n')
+				complete--;
+
+			if (complete == 0)
+				continue;
+		}
+
+		lines.clear();
+		for (std::size_t first = 0; first < complete; )
+		{
+			const char *lineEnd = static_cast<const char*>(std::memchr(buffer.data() + first, '\n', complete - first));
+			std::size_t last = lineEnd != nullptr ? lineEnd - buffer.data() : complete;
+
+			std::string_view line(buffer.data() + first, last - first);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			lines.push_back(line);
+
+			first = last + 1u;
+		}
+		numLines += lines.size();
+
+		for (std::size_t first = 0; first < lines.size(); )
+		{
+			// Lines without '=' neither assign variables nor define functions, they only read the state
+			std::size_t last = first;
+			while (last < lines.size() && lines[last].find('=') == std::string_view::npos)
+				last++;
+
+			if (threads > 1u && last - first >= ChunkLines)
+			{
+				evaluateParallel(state, lines, first, last, threads, chunks, output);
+			}
+			else
+			{
+				for (std::size_t line = first; line < last; line++)
+				{
+					appendResult(output, state.Evaluate(lines[line]));
+					if (output.size() >= WriteSize)
+						writeOutput(output);
+				}
+			}
+
+			// The line changing the state sees every line before it, the lines after it see the change
+			if (last < lines.size())
+			{
+				appendResult(output, state.Evaluate(lines[last]));
+				if (output.size() >= WriteSize)
+					writeOutput(output);
+
+				last++;
+			}
+
+			first = last;
+		}
+
+		// The incomplete line moves to the front of the buffer
+		used -= complete;
+		std::memmove(buffer.data(), buffer.data() + complete, used);
+	}
+
+	writeOutput(output);
+	std::fflush(stdout);
+
+	if (input != stdin)
+		std::fclose(input);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::fprintf(stderr, "%zu lines in %.3f s, %.0f lines/s\n", numLines, seconds, seconds > 0 ? numLines / seconds : 0.0);
+
+	return 0;
+}
+
+// Evaluates lines that only read the state, chunks of them on every thread
+static void evaluateParallel(MathExpressions::State &state, const std::vector<std::string_view> &lines, std::size_t first, std::size_t last, std::size_t threads, std::vector<std::string> &chunks, std::string &output)
+{
+	// Chunks are written in the order of the lines, no matter which thread evaluated them
+	const std::size_t numChunks = (last - first + ChunkLines - 1u) / ChunkLines;
+	if (chunks.size() < numChunks)
+		chunks.resize(numChunks);
+
+	std::atomic<std::size_t> next(0u);
+	MathInternals::ThreadPool::Get().Run(threads, [&](std::size_t, std::size_t)
+	{
+		for (std::size_t chunk = next++; chunk < numChunks; chunk = next++)
+		{
+			std::string &text = chunks[chunk];
+			text.clear();
+
+			const std::size_t end = std::min(last, first + (chunk + 1u) * ChunkLines);
+			for (std::size_t line = first + chunk * ChunkLines; line < end; line++)
+			{
+				// The shared expression cache would make the threads wait for each other
+				appendResult(text, state.Evaluate(state.Compile(lines[line])));
+			}
+		}
+	});
+
+	for (std::size_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		output += chunks[chunk];
+		if (output.size() >= WriteSize)
+			writeOutput(output);
+	}
+}
+
+static void appendResult(std::string &output, const MathExpressions::Result &res)
+{
+	// Formatted in place, only very long numbers need a string of their own
+	char text[64];
+	std::size_t length = res.GetString(text, sizeof(text));
+	if (length < sizeof(text))
+		output.append(text, length);
+	else
+		output += res.GetString();
+
+	output += '\n';
+}
+
+static void writeOutput(std::string &output)
+{
+	std::fwrite(output.data(), 1, output.size(), stdout);
+	output.clear();
 }
\ No newline at end of file
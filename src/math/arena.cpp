@@ -0,0 +1,39 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "instrumentation.h"
+
+MathInternals::Arena &MathInternals::Arena::Get()
+{
+	thread_local MathInternals::Arena arena;
+	return arena;
+}
+
+void *MathInternals::Arena::Allocate(std::size_t size, std::size_t alignment)
+{
+	// Try the current block, then the following ones that are kept from earlier calls
+	for (; m_nBlock < m_vBlocks.size(); m_nBlock++, m_nOffset = 0u)
+	{
+		Block &block = m_vBlocks[m_nBlock];
+
+		std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.memory.get()) + m_nOffset;
+		std::size_t padding = (alignment - address % alignment) % alignment;
+
+		if (m_nOffset + padding + size <= block.size)
+		{
+			m_nOffset += padding + size;
+			return block.memory.get() + m_nOffset - size;
+		}
+	}
+
+	// New blocks are aligned for any fundamental type, no padding needed at the start
+	std::size_t blockSize = std::max(size, BlockSize);
+	m_vBlocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[blockSize]), blockSize });
+	MATHEVALUATOR_COUNT(allocations, 1u);
+
+	m_nBlock = m_vBlocks.size() - 1u;
+	m_nOffset = size;
+	return m_vBlocks[m_nBlock].memory.get();
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stack>
+#include <vector>
+
+namespace MathInternals
+{
+
+	// Bump allocator for temporaries of a single call
+	// Every thread has its own arena, memory is released all at once by ArenaScope
+	// Blocks are kept after a release and reused by the following calls
+	class Arena
+	{
+
+	public:
+		// Size of a block, larger allocations get a block of their own
+		static constexpr std::size_t BlockSize = 64u * 1024u;
+
+		// Position in the arena to release the memory back to
+		struct Mark
+		{
+			std::size_t block;
+			std::size_t offset;
+		};
+
+		Arena()
+		{
+		}
+
+		Arena(const Arena&) = delete;
+
+		Arena& operator=(const Arena&) = delete;
+
+		// Arena of the calling thread
+		static Arena &Get();
+
+		void *Allocate(std::size_t size, std::size_t alignment);
+
+		Mark GetMark() const { return { m_nBlock, m_nOffset }; }
+
+		// Frees everything allocated after the mark, takes constant time
+		void Release(Mark mark)
+		{
+			m_nBlock = mark.block;
+			m_nOffset = mark.offset;
+		}
+
+	private:
+		struct Block
+		{
+			std::unique_ptr<unsigned char[]> memory;
+			std::size_t size;
+		};
+
+		std::vector<Block> m_vBlocks;
+		// Block that is allocated from, equal to the number of blocks if there are none yet
+		std::size_t m_nBlock = 0u;
+		std::size_t m_nOffset = 0u;
+
+	};
+
+	// Releases the memory allocated from the arena of the thread during its lifetime
+	// Containers using the arena have to be destroyed before the scope
+	class ArenaScope
+	{
+
+	public:
+		ArenaScope()
+			: m_arena(Arena::Get()), m_mark(m_arena.GetMark())
+		{
+		}
+
+		ArenaScope(const ArenaScope&) = delete;
+
+		ArenaScope& operator=(const ArenaScope&) = delete;
+
+		~ArenaScope()
+		{
+			m_arena.Release(m_mark);
+		}
+
+	private:
+		Arena &m_arena;
+		Arena::Mark m_mark;
+
+	};
+
+	// Allocator adapter for standard containers, deallocation is left to ArenaScope
+	template<typename T>
+	class ArenaAllocator
+	{
+
+	public:
+		using value_type = T;
+
+		ArenaAllocator()
+		{
+		}
+
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>&)
+		{
+		}
+
+		T *allocate(std::size_t count)
+		{
+			return static_cast<T*>(Arena::Get().Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T*, std::size_t)
+		{
+		}
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>&) const { return true; }
+
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>&) const { return false; }
+
+	};
+
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	template<typename T>
+	using ArenaStack = std::stack<T, ArenaVector<T>>;
+
+}
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "mathevaluator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "arena.h"
+#include "instrumentation.h"
+#include "internals.h"
+#include "kernels.h"
+#include "threadpool.h"
+
+// Instruction of the program with its input resolved
+struct BatchStep
+{
+	MathInternals::OpCode code;
+	// Position on the stack of Copy, number of values removed by Squash
+	uint32_t index;
+	// Operator to apply, nullptr for values
+	MathInternals::Operator *op;
+	// Vectorized implementation of the operator, if there is one
+	MathInternals::BlockKernel kernel;
+	// Column of a variable, nullptr for numbers
+	const MathInternals::NumberType *column;
+	MathInternals::NumberType number;
+};
+
+// Contiguous chunks of rows owned by a worker of EvaluateBatchParallel()
+// Workers that are done with their own chunks take the remaining ones of the others
+struct alignas(64) ChunkRange
+{
+	std::atomic<std::size_t> next;
+	std::size_t end;
+};
+
+static bool resolveSteps(const MathExpressions::CompiledExpression &expression, const std::vector<MathExpressions::Column> &columns, const MathInternals::State *state, MathInternals::ArenaVector<BatchStep> &steps);
+static void evaluateRows(const MathInternals::ArenaVector<BatchStep> &steps, std::size_t stackSize, std::size_t first, std::size_t last, MathInternals::NumberType *output);
+static void applyOperator(MathInternals::Operator *op, const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count);
+
+bool MathExpressions::EvaluateBatch(const MathExpressions::CompiledExpression &expression, const std::vector<MathExpressions::Column> &columns, std::size_t rows, MathInternals::NumberType *output, const MathInternals::State *state)
+{
+	if (expression.Error())
+		return false;
+
+	const MathInternals::Program &program = *expression.GetProgram();
+
+	MATHEVALUATOR_TIMER(executeTime);
+
+	MathInternals::ArenaScope arenaScope;
+	MATHEVALUATOR_COUNT(evaluations, rows);
+	MATHEVALUATOR_COUNT(executedInstructions, program.GetInstructions().size() * rows);
+
+	MathInternals::ArenaVector<BatchStep> steps;
+	if (!resolveSteps(expression, columns, state, steps))
+		return false;
+
+	evaluateRows(steps, program.GetStackSize(), 0u, rows, output);
+	return true;
+}
+
+bool MathExpressions::EvaluateBatchParallel(const MathExpressions::CompiledExpression &expression, const std::vector<MathExpressions::Column> &columns, std::size_t rows, MathInternals::NumberType *output, const MathExpressions::BatchSchedule &schedule, const MathInternals::State *state)
+{
+	if (expression.Error())
+		return false;
+
+	const MathInternals::Program &program = *expression.GetProgram();
+
+	MATHEVALUATOR_TIMER(executeTime);
+
+	MathInternals::ArenaScope arenaScope;
+	MATHEVALUATOR_COUNT(evaluations, rows);
+	MATHEVALUATOR_COUNT(executedInstructions, program.GetInstructions().size() * rows);
+
+	// Steps are resolved once and only read by the workers
+	MathInternals::ArenaVector<BatchStep> steps;
+	if (!resolveSteps(expression, columns, state, steps))
+		return false;
+
+	const std::size_t chunk = std::max<std::size_t>(schedule.chunk, 1u);
+	const std::size_t chunks = (rows + chunk - 1u) / chunk;
+
+	// Every worker needs a chunk of its own
+	std::size_t threads = schedule.threads == 0u ? MathInternals::ThreadPool::GetHardwareThreads() : schedule.threads;
+	threads = std::min({ threads, chunks, MathInternals::ThreadPool::MaxThreads });
+
+	if (threads <= 1u)
+	{
+		evaluateRows(steps, program.GetStackSize(), 0u, rows, output);
+		return true;
+	}
+
+	// Every worker owns an equal share of the chunks, the output is first written by the thread that owns it
+	std::unique_ptr<ChunkRange[]> ranges(new ChunkRange[threads]);
+	for (std::size_t worker = 0; worker < threads; worker++)
+	{
+		ranges[worker].next.store(chunks * worker / threads, std::memory_order_relaxed);
+		ranges[worker].end = chunks * (worker + 1u) / threads;
+	}
+
+	MathInternals::ThreadPool::Get().Run(threads, [&](std::size_t worker, std::size_t)
+	{
+		const std::size_t stackSize = program.GetStackSize();
+
+		// Own chunks first, then the remaining chunks of the other workers
+		for (std::size_t i = 0; i < threads; i++)
+		{
+			ChunkRange &range = ranges[(worker + i) % threads];
+			for (;;)
+			{
+				const std::size_t index = range.next.fetch_add(1u, std::memory_order_relaxed);
+				if (index >= range.end)
+					break;
+
+				evaluateRows(steps, stackSize, index * chunk, std::min(rows, (index + 1u) * chunk), output);
+			}
+		}
+	});
+
+	return true;
+}
+
+// Resolves every instruction once for all of the rows
+// Fails on assignments and undefined variables
+static bool resolveSteps(const MathExpressions::CompiledExpression &expression, const std::vector<MathExpressions::Column> &columns, const MathInternals::State *state, MathInternals::ArenaVector<BatchStep> &steps)
+{
+	const MathInternals::Program &program = *expression.GetProgram();
+
+	steps.reserve(program.GetInstructions().size());
+	for (const MathInternals::Instruction &instruction : program.GetInstructions())
+	{
+		switch (instruction.code)
+		{
+		case MathInternals::OpCode::Number:
+			steps.push_back({ instruction.code, 0u, nullptr, nullptr, nullptr, program.GetNumber(instruction.index) });
+			break;
+
+		case MathInternals::OpCode::Variable:
+		{
+			const std::string &name = program.GetVariable(instruction.index);
+
+			auto column = std::find_if(columns.begin(), columns.end(), [&name](const MathExpressions::Column &item)
+			{
+				return item.name == name;
+			});
+			if (column != columns.end())
+			{
+				steps.push_back({ instruction.code, 0u, nullptr, nullptr, column->values, 0 });
+				break;
+			}
+
+			const MathInternals::NumberType *bound = expression.GetBinding(instruction.index);
+			if (bound != nullptr)
+			{
+				steps.push_back({ instruction.code, 0u, nullptr, nullptr, nullptr, *bound });
+				break;
+			}
+
+			MathInternals::State::Slot slot = state == nullptr ? MathInternals::State::InvalidSlot : state->Find(name);
+			if (slot == MathInternals::State::InvalidSlot)
+				return false;
+
+			steps.push_back({ instruction.code, 0u, nullptr, nullptr, nullptr, state->GetValue(slot) });
+			break;
+		}
+
+		case MathInternals::OpCode::Copy:
+		case MathInternals::OpCode::Squash:
+			steps.push_back({ instruction.code, instruction.index, nullptr, nullptr, nullptr, 0 });
+			break;
+
+		case MathInternals::OpCode::Assign:
+			// Rows cannot be assigned to a single variable
+			return false;
+
+		default:
+		{
+			MathInternals::Operator *op = program.GetOperator(instruction.index);
+			steps.push_back({ instruction.code, 0u, op, MathInternals::GetBlockKernel(op), nullptr, 0 });
+			break;
+		}
+		}
+	}
+
+	return true;
+}
+
+// Evaluates the rows from first up to last, the buffers come from the arena of the calling thread
+static void evaluateRows(const MathInternals::ArenaVector<BatchStep> &steps, std::size_t stackSize, std::size_t first, std::size_t last, MathInternals::NumberType *output)
+{
+	MathInternals::ArenaScope arenaScope;
+
+	// Every level of the evaluation stack holds a block of rows
+	// Columns are read in place, only results of operators are stored in the buffers
+	MathInternals::ArenaVector<MathInternals::NumberType> buffers(stackSize * MathInternals::BatchBlockSize);
+	MathInternals::ArenaVector<const MathInternals::NumberType*> evalStack(stackSize);
+
+	for (; first < last; first += MathInternals::BatchBlockSize)
+	{
+		const std::size_t count = std::min(last - first, MathInternals::BatchBlockSize);
+		std::size_t top = 0;
+		for (const BatchStep &step : steps)
+		{
+			MathInternals::NumberType *buffer = &buffers[top * MathInternals::BatchBlockSize];
+
+			if (step.code == MathInternals::OpCode::Copy)
+			{
+				evalStack[top++] = evalStack[step.index];
+			}
+			else if (step.code == MathInternals::OpCode::Squash)
+			{
+				// The buffer of the result is reused by the next steps, its rows move down to the first argument
+				top -= step.index;
+				buffer = &buffers[(top - 1u) * MathInternals::BatchBlockSize];
+				const MathInternals::NumberType *result = evalStack[top - 1u + step.index];
+				if (result != buffer)
+					std::copy(result, result + count, buffer);
+				evalStack[top - 1u] = buffer;
+			}
+			else if (step.op != nullptr)
+			{
+				uint8_t numArgs = step.op->GetNumOperands();
+				top -= numArgs;
+
+				// The result takes the place of the first operand
+				buffer = &buffers[top * MathInternals::BatchBlockSize];
+				if (step.kernel != nullptr)
+					step.kernel(&evalStack[top], buffer, count);
+				else
+					applyOperator(step.op, &evalStack[top], buffer, count);
+				evalStack[top++] = buffer;
+			}
+			else if (step.column != nullptr)
+			{
+				evalStack[top++] = step.column + first;
+			}
+			else
+			{
+				std::fill(buffer, buffer + count, step.number);
+				evalStack[top++] = buffer;
+			}
+		}
+
+		std::copy(evalStack[0], evalStack[0] + count, output + first);
+	}
+}
+
+static void applyOperator(MathInternals::Operator *op, const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	const uint8_t numArgs = op->GetNumOperands();
+
+	// The result may overwrite the first operand, every row is read before it is written
+	MathInternals::NumberType row[MathInternals::MaxOperands];
+	for (std::size_t i = 0; i < count; i++)
+	{
+		for (uint8_t arg = 0; arg < numArgs; arg++)
+			row[arg] = args[arg][i];
+
+		result[i] = op->Evaluate(row);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "mathevaluator.h"
+
+#include "instrumentation.h"
+
+MathExpressions::CompiledExpression MathExpressions::ExpressionCache::Get(std::string_view expression)
+{
+	MATHEVALUATOR_TIMER(cacheTime);
+
+	// A disabled cache is not locked, compiling would block the other threads
+	if (m_nCapacity.load(std::memory_order_relaxed) == 0u)
+	{
+		m_nMisses.fetch_add(1u, std::memory_order_relaxed);
+		MATHEVALUATOR_COUNT(cacheMisses, 1u);
+		MATHEVALUATOR_TIMER_STOP(cacheTime);
+		return MathExpressions::Compile(expression);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_mIndex.find(expression);
+		if (it != m_mIndex.end())
+		{
+			m_nHits++;
+			MATHEVALUATOR_COUNT(cacheHits, 1u);
+
+			// Move to the front
+			m_lEntries.splice(m_lEntries.begin(), m_lEntries, it->second);
+			return it->second->compiled;
+		}
+
+		m_nMisses.fetch_add(1u, std::memory_order_relaxed);
+		MATHEVALUATOR_COUNT(cacheMisses, 1u);
+	}
+
+	// Compile without holding the lock, other threads may use the cache in the meantime
+	MATHEVALUATOR_TIMER_STOP(cacheTime);
+	MathExpressions::CompiledExpression compiled = MathExpressions::Compile(expression);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Another thread might have compiled the same expression or disabled the cache
+	const std::size_t capacity = m_nCapacity.load(std::memory_order_relaxed);
+	if (capacity == 0u || m_mIndex.find(expression) != m_mIndex.end())
+		return compiled;
+
+	Trim(capacity - 1u);
+
+	// List and index nodes
+	MATHEVALUATOR_COUNT(allocations, 2u);
+
+	m_lEntries.push_front({ std::string(expression), compiled });
+	m_mIndex.emplace(m_lEntries.front().expression, m_lEntries.begin());
+
+	return compiled;
+}
+
+void MathExpressions::ExpressionCache::SetCapacity(std::size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_nCapacity.store(capacity, std::memory_order_relaxed);
+	Trim(capacity);
+}
+
+std::size_t MathExpressions::ExpressionCache::GetCapacity() const
+{
+	return m_nCapacity.load(std::memory_order_relaxed);
+}
+
+std::size_t MathExpressions::ExpressionCache::Size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_lEntries.size();
+}
+
+void MathExpressions::ExpressionCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_mIndex.clear();
+	m_lEntries.clear();
+	m_nHits = 0u;
+	m_nMisses.store(0u, std::memory_order_relaxed);
+}
+
+std::uint64_t MathExpressions::ExpressionCache::GetHits() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_nHits;
+}
+
+std::uint64_t MathExpressions::ExpressionCache::GetMisses() const
+{
+	return m_nMisses.load(std::memory_order_relaxed);
+}
+
+// Has to be called with the lock held
+void MathExpressions::ExpressionCache::Trim(std::size_t capacity)
+{
+	while (m_lEntries.size() > capacity)
+	{
+		m_mIndex.erase(m_lEntries.back().expression);
+		m_lEntries.pop_back();
+	}
+}
+
+MathExpressions::ExpressionCache &MathExpressions::GetExpressionCache()
+{
+	static MathExpressions::ExpressionCache cache;
+	return cache;
+}
\ No newline at end of file
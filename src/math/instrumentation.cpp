@@ -0,0 +1,81 @@
+#include "mathevaluator.h"
+
+#include <atomic>
+
+#include "instrumentation.h"
+
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+
+static thread_local MathExpressions::Statistics g_statistics;
+
+static std::atomic<MathExpressions::StatisticsCallback> g_callback(nullptr);
+
+MathExpressions::Statistics &MathInternals::GetThreadStatistics()
+{
+	return g_statistics;
+}
+
+#endif
+
+bool MathExpressions::IsInstrumented()
+{
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+	return true;
+#else
+	return false;
+#endif
+}
+
+MathExpressions::Statistics MathExpressions::GetStatistics()
+{
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+	return g_statistics;
+#else
+	return MathExpressions::Statistics();
+#endif
+}
+
+void MathExpressions::ResetStatistics()
+{
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+	g_statistics = MathExpressions::Statistics();
+#endif
+}
+
+void MathExpressions::SetStatisticsCallback(MathExpressions::StatisticsCallback callback)
+{
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+	g_callback.store(callback);
+#else
+	(void)callback;
+#endif
+}
+
+MathExpressions::Statistics MathExpressions::Statistics::operator-(const MathExpressions::Statistics &other) const
+{
+	MathExpressions::Statistics difference;
+	difference.parseTime = parseTime - other.parseTime;
+	difference.optimizeTime = optimizeTime - other.optimizeTime;
+	difference.cacheTime = cacheTime - other.cacheTime;
+	difference.executeTime = executeTime - other.executeTime;
+	difference.formatTime = formatTime - other.formatTime;
+	difference.compilations = compilations - other.compilations;
+	difference.instructions = instructions - other.instructions;
+	difference.evaluations = evaluations - other.evaluations;
+	difference.executedInstructions = executedInstructions - other.executedInstructions;
+	difference.allocations = allocations - other.allocations;
+	difference.cacheHits = cacheHits - other.cacheHits;
+	difference.cacheMisses = cacheMisses - other.cacheMisses;
+	return difference;
+}
+
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+
+void MathInternals::ReportCall(const MathExpressions::Statistics &before)
+{
+	MathExpressions::StatisticsCallback callback = g_callback.load(std::memory_order_relaxed);
+	if (callback != nullptr)
+		callback(g_statistics - before);
+}
+
+#endif
\ No newline at end of file
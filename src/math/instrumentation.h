@@ -0,0 +1,66 @@
+#pragma once
+
+#include "mathevaluator.h"
+
+// Hooks of the hot paths, expand to nothing unless MATHEVALUATOR_INSTRUMENTATION is defined
+#ifdef MATHEVALUATOR_INSTRUMENTATION
+
+#include <chrono>
+
+namespace MathInternals
+{
+
+	// Statistics of the calling thread
+	MathExpressions::Statistics &GetThreadStatistics();
+
+	// Passes the statistics gathered since the beginning of the call to the callback
+	void ReportCall(const MathExpressions::Statistics &before);
+
+	// Adds the time until it is stopped or destroyed to a phase
+	class PhaseTimer
+	{
+
+	public:
+		PhaseTimer(std::uint64_t MathExpressions::Statistics::*phase)
+			: m_phase(phase), m_start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~PhaseTimer()
+		{
+			Stop();
+		}
+
+		void Stop()
+		{
+			if (m_phase == nullptr)
+				return;
+
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - m_start;
+			GetThreadStatistics().*m_phase += static_cast<std::uint64_t>(elapsed.count());
+			m_phase = nullptr;
+		}
+
+	private:
+		std::uint64_t MathExpressions::Statistics::*m_phase;
+		std::chrono::steady_clock::time_point m_start;
+
+	};
+
+}
+
+#define MATHEVALUATOR_TIMER(phase) MathInternals::PhaseTimer timer_##phase(&MathExpressions::Statistics::phase)
+#define MATHEVALUATOR_TIMER_STOP(phase) timer_##phase.Stop()
+#define MATHEVALUATOR_COUNT(counter, n) (MathInternals::GetThreadStatistics().counter += (n))
+#define MATHEVALUATOR_CALL_BEGIN() const MathExpressions::Statistics callStatistics = MathInternals::GetThreadStatistics()
+#define MATHEVALUATOR_CALL_END() MathInternals::ReportCall(callStatistics)
+
+#else
+
+#define MATHEVALUATOR_TIMER(phase) ((void)0)
+#define MATHEVALUATOR_TIMER_STOP(phase) ((void)0)
+#define MATHEVALUATOR_COUNT(counter, n) ((void)0)
+#define MATHEVALUATOR_CALL_BEGIN() ((void)0)
+#define MATHEVALUATOR_CALL_END() ((void)0)
+
+#endif
\ No newline at end of file
@@ -1,8 +1,8 @@
 #pragma once
 
 #include <cstdint>
-#include <stack>
 #include <functional>
+#include <vector>
 
 #include "mathevaluator.h"
 
@@ -11,145 +11,240 @@ namespace MathInternals
 
 	constexpr uint8_t FunctionPrecedence = 5u;
 
-	class Token
-	{
+	// Largest number of operands an operator can take
+	constexpr uint8_t MaxOperands = 2u;
 
-	public:
-		virtual bool IsOperator() = 0;
-		virtual bool IsVariable() = 0;
-	
-	};
+	// Largest number of parameters of a user-defined function
+	constexpr std::size_t MaxParameters = 32u;
+
+	// Depth of the evaluation stack that is kept on the call stack
+	// Deeper programs allocate their evaluation stack on the heap
+	constexpr std::size_t LocalStackSize = 64u;
+
+	// Number of rows processed by each operator at once in EvaluateBatch()
+	constexpr std::size_t BatchBlockSize = 256u;
 
-	class Operand : public Token
+	using OperatorFunction = NumberType(*)(const NumberType *args);
+
+	class Operator
 	{
 
 	public:
-		// Warning: To be used for "empty" operand
-		Operand()
-			: m_value(0)
+		Operator(std::string op, uint8_t num, uint8_t precedence, bool leftAssociate, OperatorFunction fn, bool pure = true)
+			: m_sOperatorName(op), m_numOperands(num), m_nPrecedence(precedence), m_bLeftAssociate(leftAssociate), m_bPure(pure), m_fnOperation(fn)
 		{
 		}
 
-		Operand(NumberType value)
-			: m_value(value)
+		Operator()
 		{
 		}
 
-		virtual bool IsOperator() override { return false; }
+		std::string &GetName() { return m_sOperatorName; }
 
-		virtual bool IsVariable() override { return false; }
+		uint8_t GetNumOperands() { return m_numOperands; }
 
-		virtual NumberType GetValue() { return m_value; }
+		uint8_t GetPrecedence() { return m_nPrecedence; }
 
-		operator NumberType() { return GetValue(); }
+		uint8_t IsLeftAssociate() { return m_bLeftAssociate; }
+
+		// The result depends on the operands only, so it may be computed at compile time
+		bool IsPure() { return m_bPure; }
+
+		NumberType Evaluate(const NumberType *args) { return m_fnOperation(args); }
+
+		OperatorFunction GetFunction() { return m_fnOperation; }
 
 	private:
-		// ToDo: Implement integer operands
-		NumberType m_value;
+		std::string m_sOperatorName;
+		uint8_t m_numOperands;
+		uint8_t m_nPrecedence;
+		bool m_bLeftAssociate;
+		bool m_bPure = true;
+		OperatorFunction m_fnOperation;
 
 	};
 
-	class Variable : public Operand
+	using AssignmentOperatorFunction = NumberType(*)(MathInternals::State &state, const std::string &name, NumberType value);
+
+	class AssignmentOperator : public Operator
 	{
 
 	public:
-		Variable(std::string_view name)
-			: Operand(), m_sName(name), m_bInitialized(false)
-		{
-		}
-
-		Variable(std::string_view name, NumberType value)
-			: Operand(), m_sName(name), m_value(value), m_bInitialized(true)
+		// Binds looser than any other operator
+		AssignmentOperator(std::string op, AssignmentOperatorFunction fn)
+			: Operator(op, 2u, 0u, false, nullptr), m_fnOperation(fn)
 		{
 		}
 
-		virtual bool IsVariable() override { return true; }
+		NumberType Evaluate(MathInternals::State &state, const std::string &name, NumberType value) { return m_fnOperation(state, name, value); }
 
-		std::string GetName() { return m_sName; }
+	private:
+		AssignmentOperatorFunction m_fnOperation;
 
-		bool IsInitialized() { return m_bInitialized; }
+	};
 
-		NumberType GetValue() { return m_value; }
+	// Operation performed by an instruction
+	enum class OpCode : uint8_t
+	{
+		// Pushes a number of the program
+		Number,
+		// Pushes the value of a variable, looked up by name on evaluation
+		Variable,
+		// Pushes a copy of the value at the given position of the evaluation stack
+		// Reads the arguments of an inlined function
+		Copy,
+		// Moves the value on top of the stack down over the given number of values below it
+		// Removes the arguments of an inlined function
+		Squash,
+		// Assigns the value on top of the stack to the variable below it
+		Assign,
+
+		/* Operators evaluated in place */
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Negate,
+
+		// Applies any other operator through its function
+		Call
+	};
 
-		operator NumberType() { return GetValue(); }
+	// Fixed size instruction of a program
+	struct Instruction
+	{
+		OpCode code;
+		// Index of the number, variable or operator of the program, depending on the code
+		uint32_t index;
+	};
 
-	private:
-		std::string m_sName;
-		bool m_bInitialized;
-		NumberType m_value;
+	// Entry of the evaluation stack
+	// Values pushed by variables keep the index of the variable to be assignable
+	struct Value
+	{
+		static constexpr uint32_t NoVariable = ~static_cast<uint32_t>(0);
 
+		NumberType number;
+		uint32_t variable;
+		bool defined;
 	};
 
-	using OperandStack = std::stack<Operand*>;
-	using OperatorFunction = NumberType(*)(OperandStack&);
-
-	class Operator : public Token
+	// Output of the shunting-yard algorithm
+	// Instructions refer to the numbers, variable names and operators stored alongside them
+	// Operators point into the global tables below
+	class Program
 	{
 
 	public:
-		Operator(std::string op, uint8_t num, uint8_t precedence, bool leftAssociate, OperatorFunction fn)
-			: m_sOperatorName(op), m_numOperands(num), m_nPrecedence(precedence), m_bLeftAssociate(leftAssociate), m_fnOperation(fn)
+		Program()
 		{
 		}
 
-		Operator()
-		{
-		}
+		Program(const Program&) = delete;
 
-		virtual bool IsOperator() override { return true; }
+		Program& operator=(const Program&) = delete;
 
-		virtual bool IsVariable() override { return false; }
+		void PushNumber(NumberType value);
 
-		std::string &GetName() { return m_sOperatorName; }
+		// Every name is stored once, no matter how many times it is used
+		void PushVariable(std::string_view name);
 
-		uint8_t GetNumOperands() { return m_numOperands; }
+		void PushOperator(Operator *op);
 
-		uint8_t GetPrecedence() { return m_nPrecedence; }
+		// Inlines the body of a user-defined function, its arguments are the values on top of the stack
+		void PushFunction(const State::Function &function);
 
-		uint8_t IsLeftAssociate() { return m_bLeftAssociate; }
+		const std::vector<Instruction> &GetInstructions() const { return m_vInstructions; }
+
+		NumberType GetNumber(uint32_t index) const { return m_vNumbers[index]; }
 
-		Operand Evaluate(OperandStack &args) { return Operand(m_fnOperation(args)); }
+		const std::string &GetVariable(uint32_t index) const { return m_vVariables[index]; }
+
+		const std::vector<std::string> &GetVariables() const { return m_vVariables; }
+
+		Operator *GetOperator(uint32_t index) const { return m_vOperators[index]; }
+
+		// Number of values the instruction takes off the evaluation stack
+		uint8_t GetNumOperands(const Instruction &instruction) const
+		{
+			if (instruction.code == OpCode::Number || instruction.code == OpCode::Variable || instruction.code == OpCode::Copy)
+				return 0u;
+			if (instruction.code == OpCode::Squash)
+				return static_cast<uint8_t>(instruction.index + 1u);
+
+			return m_vOperators[instruction.index]->GetNumOperands();
+		}
+
+		// Largest number of values on the evaluation stack
+		std::size_t GetStackSize() const { return m_nStackSize; }
+
+		// Operators always have enough operands and a single value remains in the end
+		bool IsComplete() const { return !m_bUnderflow && m_nDepth == 1u; }
+
+		// Folds constant subexpressions and removes operations that leave their operand unchanged
+		// The program has to be complete
+		void Optimize();
 
 	private:
-		std::string m_sOperatorName;
-		uint8_t m_numOperands;
-		uint8_t m_nPrecedence;
-		bool m_bLeftAssociate;
-		OperatorFunction m_fnOperation;
+		void Push(Instruction instruction);
 
-	};
+		std::vector<Instruction> m_vInstructions;
+		std::vector<NumberType> m_vNumbers;
+		std::vector<std::string> m_vVariables;
+		std::vector<Operator*> m_vOperators;
+		std::size_t m_nDepth = 0u;
+		std::size_t m_nStackSize = 0u;
+		bool m_bUnderflow = false;
 
-	using AssignmentOperatorFunction = NumberType(*)(MathInternals::State &state, std::string name, Operand *operand);
+	};
 
-	class AssignmentOperator : public Operator
+	// Trie over the names of all operators and constants
+	// Resolves a name in a single pass, one character at a time
+	class SymbolTrie
 	{
 
 	public:
-		AssignmentOperator(std::string op, AssignmentOperatorFunction fn)
-			: Operator(), m_sOperatorName(op), m_fnOperation(fn)
-		{
-		}
+		using Node = uint16_t;
 
-		/*
-		virtual bool IsOperator() override { return true; }
+		// Node of an empty name
+		static constexpr Node Root = 0u;
 
-		std::string &GetName() { return m_sOperatorName; }
+		// Node of a name that is not a prefix of any symbol
+		static constexpr Node NoMatch = 0xFFFFu;
 
-		uint8_t GetNumOperands() { return m_numOperands; }
+		// Built on first use, the tables are defined in other translation units
+		static const SymbolTrie &Get();
 
-		uint8_t GetPrecedence() { return m_nPrecedence; }
+		SymbolTrie(const SymbolTrie&) = delete;
 
-		uint8_t IsLeftAssociate() { return m_bLeftAssociate; }
-		*/
+		SymbolTrie& operator=(const SymbolTrie&) = delete;
 
-		Operand Evaluate(MathInternals::State &state, std::string name, Operand *operand) { return Operand(m_fnOperation(state, name, operand)); }
+		Node Next(Node node, unsigned char token) const
+		{
+			uint8_t character = m_aAlphabet[token];
+			if (node == NoMatch || character == 0u)
+				return NoMatch;
+
+			return m_vTransitions[node * m_nAlphabetSize + character];
+		}
+
+		// Returns nullptr if the name does not belong to an operator
+		Operator *GetOperator(Node node) const { return node == NoMatch ? nullptr : m_vOperators[node]; }
+
+		// Returns nullptr if the name does not belong to a constant
+		const NumberType *GetConstant(Node node) const { return node == NoMatch ? nullptr : m_vConstants[node]; }
 
 	private:
-		std::string m_sOperatorName;
-		const uint8_t m_numOperands = 2u;
-		const uint8_t m_nPrecedence = FunctionPrecedence;
-		const bool m_bLeftAssociate = false;
-		AssignmentOperatorFunction m_fnOperation;
+		SymbolTrie();
+
+		Node AddName(const std::string &name);
+
+		// Maps characters used in names to columns of the transition table, 0 for other characters
+		uint8_t m_aAlphabet[256];
+		std::size_t m_nAlphabetSize;
+		std::vector<Node> m_vTransitions;
+		std::vector<Operator*> m_vOperators;
+		std::vector<const NumberType*> m_vConstants;
 
 	};
 
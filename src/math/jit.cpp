@@ -0,0 +1,300 @@
+#include "mathevaluator.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "instrumentation.h"
+#include "internals.h"
+#include "jit.h"
+
+#ifdef MATHEVALUATOR_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef MATHEVALUATOR_JIT
+
+// Writes x86-64 instructions into a buffer
+// The evaluation stack lives in the stack frame, every value has its own 8 byte slot
+// Follows the System V AMD64 calling convention
+class Assembler
+{
+
+public:
+	// First argument of the generated function
+	static constexpr std::uint8_t ArgumentRegister = 7u; // rdi
+
+	Assembler(std::size_t stackSize)
+		: m_nFrameSize(static_cast<std::int32_t>((8u * stackSize + 15u) & ~static_cast<std::size_t>(15u)))
+	{
+	}
+
+	// rbx keeps the pointer to the variables across calls
+	void Prologue()
+	{
+		Emit({ 0x53 }); // push rbx
+		Emit({ 0x48, 0x81, 0xEC }); // sub rsp, imm32
+		Emit32(m_nFrameSize);
+		Emit({ 0x48, 0x89, static_cast<std::uint8_t>(0xC3 | (ArgumentRegister << 3)) }); // mov rbx, arg
+	}
+
+	// Returns the bottom of the evaluation stack
+	void Epilogue()
+	{
+		Emit({ 0xF2, 0x0F, 0x10 }); // movsd xmm0, [rsp + slot]
+		EmitSlot(0u, 0u);
+		Emit({ 0x48, 0x81, 0xC4 }); // add rsp, imm32
+		Emit32(m_nFrameSize);
+		Emit({ 0x5B }); // pop rbx
+		Emit({ 0xC3 }); // ret
+	}
+
+	void LoadNumber(std::size_t slot, MathInternals::NumberType value)
+	{
+		std::uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		Emit({ 0x48, 0xB8 }); // mov rax, imm64
+		Emit64(bits);
+		Emit({ 0x48, 0x89 }); // mov [rsp + slot], rax
+		EmitSlot(slot, 0u);
+	}
+
+	void LoadVariable(std::size_t slot, std::size_t index)
+	{
+		Emit({ 0x48, 0x8B, 0x83 }); // mov rax, [rbx + disp32]
+		Emit32(static_cast<std::int32_t>(8u * index));
+		Emit({ 0x48, 0x89 }); // mov [rsp + slot], rax
+		EmitSlot(slot, 0u);
+	}
+
+	void Move(std::size_t from, std::size_t to)
+	{
+		Emit({ 0x48, 0x8B }); // mov rax, [rsp + from]
+		EmitSlot(from, 0u);
+		Emit({ 0x48, 0x89 }); // mov [rsp + to], rax
+		EmitSlot(to, 0u);
+	}
+
+	// slot = slot <op> (slot + 1), opcode of addsd, subsd, mulsd or divsd
+	void Arithmetic(std::size_t slot, std::uint8_t opcode)
+	{
+		Emit({ 0xF2, 0x0F, 0x10 }); // movsd xmm0, [rsp + slot]
+		EmitSlot(slot, 0u);
+		Emit({ 0xF2, 0x0F, opcode }); // <op>sd xmm0, [rsp + slot + 1]
+		EmitSlot(slot + 1u, 0u);
+		Emit({ 0xF2, 0x0F, 0x11 }); // movsd [rsp + slot], xmm0
+		EmitSlot(slot, 0u);
+	}
+
+	void SquareRoot(std::size_t slot)
+	{
+		Emit({ 0xF2, 0x0F, 0x51 }); // sqrtsd xmm0, [rsp + slot]
+		EmitSlot(slot, 0u);
+		Emit({ 0xF2, 0x0F, 0x11 }); // movsd [rsp + slot], xmm0
+		EmitSlot(slot, 0u);
+	}
+
+	// Flips the sign bit, same as negating the number
+	void Negate(std::size_t slot)
+	{
+		Emit({ 0x48, 0x0F, 0xBA }); // btc qword [rsp + slot], 63
+		EmitSlot(slot, 7u);
+		Emit({ 63 });
+	}
+
+	// slot = fn(&slot), the operands are already in order in the stack frame
+	void Call(std::size_t slot, MathInternals::OperatorFunction fn)
+	{
+		Emit({ 0x48, 0x8D }); // lea arg, [rsp + slot]
+		EmitSlot(slot, ArgumentRegister);
+		Emit({ 0x48, 0xB8 }); // mov rax, imm64
+		Emit64(reinterpret_cast<std::uint64_t>(fn));
+		Emit({ 0xFF, 0xD0 }); // call rax
+		Emit({ 0xF2, 0x0F, 0x11 }); // movsd [rsp + slot], xmm0
+		EmitSlot(slot, 0u);
+	}
+
+	const std::vector<std::uint8_t> &GetCode() const { return m_vCode; }
+
+private:
+	void Emit(std::initializer_list<std::uint8_t> bytes)
+	{
+		m_vCode.insert(m_vCode.end(), bytes);
+	}
+
+	void Emit32(std::int32_t value)
+	{
+		for (std::size_t i = 0; i < 4u; i++)
+			m_vCode.push_back(static_cast<std::uint8_t>(static_cast<std::uint32_t>(value) >> (8u * i)));
+	}
+
+	void Emit64(std::uint64_t value)
+	{
+		for (std::size_t i = 0; i < 8u; i++)
+			m_vCode.push_back(static_cast<std::uint8_t>(value >> (8u * i)));
+	}
+
+	// ModRM and SIB bytes of [rsp + disp32] followed by the displacement
+	void EmitSlot(std::size_t slot, std::uint8_t reg)
+	{
+		Emit({ static_cast<std::uint8_t>(0x84 | (reg << 3)), 0x24 });
+		Emit32(static_cast<std::int32_t>(8u * slot));
+	}
+
+	std::int32_t m_nFrameSize;
+	std::vector<std::uint8_t> m_vCode;
+
+};
+
+#endif
+
+MathInternals::NativeCode::~NativeCode()
+{
+#ifdef MATHEVALUATOR_JIT
+	if (m_pMemory != nullptr)
+		munmap(m_pMemory, m_nSize);
+#endif
+}
+
+std::unique_ptr<MathInternals::NativeCode> MathInternals::NativeCode::Generate(const MathInternals::Program &program)
+{
+#ifdef MATHEVALUATOR_JIT
+	// Large frames would need probing of the guard pages
+	if (program.GetStackSize() > LocalStackSize)
+		return nullptr;
+
+	// Values of the variables are copied into a local array on evaluation
+	if (program.GetVariables().size() > LocalStackSize)
+		return nullptr;
+
+	std::unique_ptr<NativeCode> native(new NativeCode());
+
+	Assembler assembler(program.GetStackSize());
+	assembler.Prologue();
+
+	std::size_t top = 0;
+	for (const Instruction &instruction : program.GetInstructions())
+	{
+		switch (instruction.code)
+		{
+		case OpCode::Number:
+			assembler.LoadNumber(top++, program.GetNumber(instruction.index));
+			break;
+
+		case OpCode::Variable:
+			assembler.LoadVariable(top++, instruction.index);
+			break;
+
+		case OpCode::Copy:
+			assembler.Move(instruction.index, top++);
+			break;
+
+		case OpCode::Squash:
+			top -= instruction.index;
+			assembler.Move(top - 1u + instruction.index, top - 1u);
+			break;
+
+		case OpCode::Assign:
+			// Assignments modify the state, left to the interpreter
+			return nullptr;
+
+		case OpCode::Add:
+			assembler.Arithmetic(--top - 1u, 0x58);
+			break;
+
+		case OpCode::Subtract:
+			assembler.Arithmetic(--top - 1u, 0x5C);
+			break;
+
+		case OpCode::Multiply:
+			assembler.Arithmetic(--top - 1u, 0x59);
+			break;
+
+		case OpCode::Divide:
+			assembler.Arithmetic(--top - 1u, 0x5E);
+			break;
+
+		case OpCode::Negate:
+			assembler.Negate(top - 1u);
+			break;
+
+		case OpCode::Call:
+		{
+			Operator *op = program.GetOperator(instruction.index);
+			top -= op->GetNumOperands();
+
+			if (op->GetName() == "sqrt")
+				assembler.SquareRoot(top);
+			else
+				assembler.Call(top, op->GetFunction());
+
+			top++;
+			break;
+		}
+		}
+	}
+
+	assembler.Epilogue();
+
+	// Written while the pages are writable, executed once they are made read-only
+	const std::vector<std::uint8_t> &code = assembler.GetCode();
+	native->m_nSize = code.size();
+
+	void *memory = mmap(nullptr, native->m_nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return nullptr;
+
+	native->m_pMemory = memory;
+	std::memcpy(memory, code.data(), code.size());
+
+	if (mprotect(memory, native->m_nSize, PROT_READ | PROT_EXEC) != 0)
+		return nullptr;
+
+	native->m_fnCode = reinterpret_cast<Function>(native->m_pMemory);
+	return native;
+#else
+	return nullptr;
+#endif
+}
+
+MathExpressions::JitExpression::JitExpression(const MathExpressions::CompiledExpression &expression)
+	: m_expression(expression)
+{
+	if (!expression.Error())
+		m_native = MathInternals::NativeCode::Generate(*expression.GetProgram());
+}
+
+MathExpressions::Result MathExpressions::JitExpression::Evaluate(MathInternals::State *state) const
+{
+	if (m_native == nullptr)
+		return m_expression.Evaluate(state);
+
+	MATHEVALUATOR_TIMER(executeTime);
+	MATHEVALUATOR_COUNT(evaluations, 1u);
+	MATHEVALUATOR_COUNT(executedInstructions, m_expression.GetProgram()->GetInstructions().size());
+
+	const std::vector<std::string> &names = m_expression.GetProgram()->GetVariables();
+
+	// Programs without assignments need every variable to be defined
+	MathInternals::NumberType variables[MathInternals::LocalStackSize];
+	for (std::size_t i = 0; i < names.size(); i++)
+	{
+		const MathInternals::NumberType *bound = m_expression.GetBinding(i);
+		if (bound != nullptr)
+		{
+			variables[i] = *bound;
+			continue;
+		}
+
+		MathInternals::State::Slot slot = state != nullptr ? state->Find(names[i]) : MathInternals::State::InvalidSlot;
+		if (slot == MathInternals::State::InvalidSlot)
+			return MathExpressions::Result();
+
+		variables[i] = state->GetValue(slot);
+	}
+
+	return MathExpressions::Result(m_native->GetFunction()(variables));
+}
\ No newline at end of file
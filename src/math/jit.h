@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "internals.h"
+
+// Windows would need unwind information registered for the generated code, it uses the interpreter
+#if defined(__x86_64__) && !defined(_WIN32)
+#define MATHEVALUATOR_JIT
+#endif
+
+namespace MathInternals
+{
+
+	// Machine code generated for a program, lives in its own executable pages
+	class NativeCode
+	{
+
+	public:
+		// Takes the values of the variables in the order of Program::GetVariables()
+		using Function = NumberType(*)(const NumberType *variables);
+
+		NativeCode(const NativeCode&) = delete;
+
+		NativeCode& operator=(const NativeCode&) = delete;
+
+		~NativeCode();
+
+		// Returns nullptr if the target is not supported or the program cannot be translated
+		static std::unique_ptr<NativeCode> Generate(const Program &program);
+
+		Function GetFunction() const { return m_fnCode; }
+
+	private:
+		NativeCode()
+		{
+		}
+
+		void *m_pMemory = nullptr;
+		std::size_t m_nSize = 0u;
+		Function m_fnCode = nullptr;
+
+	};
+
+}
\ No newline at end of file
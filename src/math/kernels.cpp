@@ -0,0 +1,243 @@
+#include "kernels.h"
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+
+#ifdef MATHEVALUATOR_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#endif
+
+// Portable kernels, written as plain loops over the rows
+
+static void scalarAdd(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[0][i] + args[1][i];
+}
+
+static void scalarSubtract(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[0][i] - args[1][i];
+}
+
+static void scalarMultiply(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[0][i] * args[1][i];
+}
+
+static void scalarDivide(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[0][i] / args[1][i];
+}
+
+static void scalarNegate(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = -args[0][i];
+}
+
+static void scalarSqrt(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::sqrt(static_cast<double>(args[0][i])));
+}
+
+static void scalarExp(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::exp(static_cast<double>(args[0][i])));
+}
+
+static void scalarLn(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::log(static_cast<double>(args[0][i])));
+}
+
+// Squares are multiplied, the product is rounded once the same as the result of std::pow()
+static void scalarPow(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[1][i] == 2 ? args[0][i] * args[0][i] : static_cast<MathInternals::NumberType>(std::pow(static_cast<double>(args[0][i]), static_cast<double>(args[1][i])));
+}
+
+static void scalarSin(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::sin(static_cast<double>(args[0][i])));
+}
+
+static void scalarCos(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::cos(static_cast<double>(args[0][i])));
+}
+
+static void scalarMax(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[0][i] > args[1][i] ? args[0][i] : args[1][i];
+}
+
+static void scalarMin(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = args[0][i] < args[1][i] ? args[0][i] : args[1][i];
+}
+
+static void scalarAbs(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::abs(args[0][i]));
+}
+
+static void scalarRound(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::round(static_cast<double>(args[0][i])));
+}
+
+static void scalarCeil(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::ceil(static_cast<double>(args[0][i])));
+}
+
+static void scalarFloor(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::floor(static_cast<double>(args[0][i])));
+}
+
+static void scalarMod(const MathInternals::NumberType *const *args, MathInternals::NumberType *result, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		result[i] = static_cast<MathInternals::NumberType>(std::fmod(static_cast<double>(args[0][i]), static_cast<double>(args[1][i])));
+}
+
+const MathInternals::KernelTable MathInternals::g_scalarKernels =
+{
+	/* Basic operators */
+	scalarAdd,
+	scalarSubtract,
+	scalarMultiply,
+	scalarDivide,
+	scalarNegate,
+
+	/* Power and exponentials */
+	scalarSqrt,
+	scalarExp,
+	scalarLn,
+	scalarPow,
+
+	/* Trigonometry */
+	scalarSin,
+	scalarCos,
+
+	/* Number functions */
+	scalarMax,
+	scalarMin,
+	scalarAbs,
+	scalarRound,
+	scalarCeil,
+	scalarFloor,
+	scalarMod
+};
+
+static bool supportsAvx2()
+{
+#if !defined(MATHEVALUATOR_X86)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// FMA, OSXSAVE and AVX
+	__cpuid(info, 1);
+	if ((info[2] & 0x18001000) != 0x18001000)
+		return false;
+
+	// The operating system has to preserve the YMM registers
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & 0x20) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+// Picks the kernel of the best instruction set that implements it
+static MathInternals::BlockKernel selectKernel(MathInternals::BlockKernel MathInternals::KernelTable::*kernel)
+{
+	static const bool bAvx2 = supportsAvx2();
+
+	if (bAvx2 && MathInternals::g_avx2Kernels.*kernel != nullptr)
+		return MathInternals::g_avx2Kernels.*kernel;
+
+	if (MathInternals::g_sse2Kernels.*kernel != nullptr)
+		return MathInternals::g_sse2Kernels.*kernel;
+
+	return MathInternals::g_scalarKernels.*kernel;
+}
+
+MathInternals::BlockKernel MathInternals::GetBlockKernel(const MathInternals::Operator *op)
+{
+	// Built on first use, the operators are defined in another translation unit
+	static const std::unordered_map<const MathInternals::Operator*, MathInternals::BlockKernel> kernels = []()
+	{
+		const std::pair<std::string, MathInternals::BlockKernel MathInternals::KernelTable::*> names[] =
+		{
+			{ "+", &MathInternals::KernelTable::add },
+			{ "-", &MathInternals::KernelTable::subtract },
+			{ "*", &MathInternals::KernelTable::multiply },
+			{ "/", &MathInternals::KernelTable::divide },
+			{ "sqrt", &MathInternals::KernelTable::sqrt },
+			{ "exp", &MathInternals::KernelTable::exp },
+			{ "ln", &MathInternals::KernelTable::ln },
+			{ "^", &MathInternals::KernelTable::pow },
+			{ "pow", &MathInternals::KernelTable::pow },
+			{ "sin", &MathInternals::KernelTable::sin },
+			{ "cos", &MathInternals::KernelTable::cos },
+			{ "max", &MathInternals::KernelTable::max },
+			{ "min", &MathInternals::KernelTable::min },
+			{ "abs", &MathInternals::KernelTable::abs },
+			{ "round", &MathInternals::KernelTable::round },
+			{ "ceil", &MathInternals::KernelTable::ceil },
+			{ "floor", &MathInternals::KernelTable::floor },
+			{ "%", &MathInternals::KernelTable::mod },
+			{ "mod", &MathInternals::KernelTable::mod }
+		};
+
+		std::unordered_map<const MathInternals::Operator*, MathInternals::BlockKernel> table;
+		table[&MathInternals::g_negation] = selectKernel(&MathInternals::KernelTable::negate);
+
+		for (const auto &item : names)
+		{
+			for (MathInternals::Operator &op : MathInternals::g_vOperators)
+			{
+				if (op.GetName() == item.first)
+				{
+					table[&op] = selectKernel(item.second);
+					break;
+				}
+			}
+		}
+
+		return table;
+	}();
+
+	auto it = kernels.find(op);
+	return it == kernels.end() ? nullptr : it->second;
+}
\ No newline at end of file
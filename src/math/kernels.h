@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+#include "internals.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATHEVALUATOR_X86
+#endif
+
+namespace MathInternals
+{
+
+	// Applies an operator to a block of rows, args holds one array per operand
+	// The result may alias the first operand
+	using BlockKernel = void(*)(const NumberType *const *args, NumberType *result, std::size_t count);
+
+	// Kernels of the operators that have a vectorized implementation
+	// nullptr if the instruction set has no implementation of its own
+	struct KernelTable
+	{
+		/* Basic operators */
+		BlockKernel add;
+		BlockKernel subtract;
+		BlockKernel multiply;
+		BlockKernel divide;
+		BlockKernel negate;
+
+		/* Power and exponentials */
+		BlockKernel sqrt;
+		BlockKernel exp;
+		BlockKernel ln;
+		BlockKernel pow;
+
+		/* Trigonometry */
+		BlockKernel sin;
+		BlockKernel cos;
+
+		/* Number functions */
+		BlockKernel max;
+		BlockKernel min;
+		BlockKernel abs;
+		BlockKernel round;
+		BlockKernel ceil;
+		BlockKernel floor;
+		BlockKernel mod;
+	};
+
+	// Portable loops, used when the processor supports no other instruction set
+	extern const KernelTable g_scalarKernels;
+
+	// Available on every x86-64 processor
+	extern const KernelTable g_sse2Kernels;
+
+	// Selected at runtime if the processor supports AVX2 and FMA
+	extern const KernelTable g_avx2Kernels;
+
+	// Kernel of the best instruction set supported by the processor
+	// Returns nullptr if the operator has no kernel, it has to be applied one row at a time then
+	BlockKernel GetBlockKernel(const Operator *op);
+
+}
\ No newline at end of file
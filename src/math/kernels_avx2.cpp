@@ -0,0 +1,158 @@
+#include "kernels.h"
+
+#ifdef MATHEVALUATOR_X86
+
+// Included before the instruction set is changed, inline functions of the library have to stay portable
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+// Only this translation unit is compiled for AVX2, it is called after the processor is checked
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include <immintrin.h>
+
+#include "simd.h"
+
+namespace
+{
+
+	// Lane-wise primitives of AVX2 with FMA, four lanes per vector
+	struct Avx2
+	{
+		using Vector = __m256d;
+		using Integer = __m256i;
+
+		static constexpr std::size_t Width = 4u;
+
+		static Vector Load(const double *values) { return _mm256_loadu_pd(values); }
+
+		static void Store(double *values, Vector x) { _mm256_storeu_pd(values, x); }
+
+		static Vector Set(double x) { return _mm256_set1_pd(x); }
+
+		static Integer SetInteger(long long x) { return _mm256_set1_epi64x(x); }
+
+		static Vector Add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+
+		static Vector Sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+
+		static Vector Mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+
+		static Vector Div(Vector a, Vector b) { return _mm256_div_pd(a, b); }
+
+		static Vector MulAdd(Vector a, Vector b, Vector c) { return _mm256_fmadd_pd(a, b, c); }
+
+		static Vector Sqrt(Vector x) { return _mm256_sqrt_pd(x); }
+
+		static Vector Max(Vector a, Vector b) { return _mm256_max_pd(a, b); }
+
+		static Vector Min(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+
+		static Vector And(Vector a, Vector b) { return _mm256_and_pd(a, b); }
+
+		static Vector Or(Vector a, Vector b) { return _mm256_or_pd(a, b); }
+
+		static Vector Xor(Vector a, Vector b) { return _mm256_xor_pd(a, b); }
+
+		// ~a & b
+		static Vector AndNot(Vector a, Vector b) { return _mm256_andnot_pd(a, b); }
+
+		static Vector Equal(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+
+		static Vector Less(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+
+		static Vector LessEqual(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+
+		static Vector GreaterEqual(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+
+		static Vector Select(Vector mask, Vector a, Vector b) { return _mm256_blendv_pd(b, a, mask); }
+
+		static bool All(Vector mask) { return _mm256_movemask_pd(mask) == 0xF; }
+
+		static Integer AsInteger(Vector x) { return _mm256_castpd_si256(x); }
+
+		static Vector AsVector(Integer x) { return _mm256_castsi256_pd(x); }
+
+		static Integer AddInteger(Integer a, Integer b) { return _mm256_add_epi64(a, b); }
+
+		template<int Bits>
+		static Integer ShiftLeft(Integer x) { return _mm256_slli_epi64(x, Bits); }
+
+		template<int Bits>
+		static Integer ShiftRight(Integer x) { return _mm256_srli_epi64(x, Bits); }
+
+		// Lanes where all of the bits are set
+		static Vector TestBits(Integer x, long long bits)
+		{
+			Integer mask = _mm256_set1_epi64x(bits);
+			return _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(x, mask), mask));
+		}
+	};
+
+	Avx2::Vector Floor(Avx2::Vector x) { return _mm256_round_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	Avx2::Vector Ceil(Avx2::Vector x) { return _mm256_round_pd(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+
+	// Halfway cases are rounded away from zero, same as std::round()
+	Avx2::Vector Round(Avx2::Vector x)
+	{
+		Avx2::Vector truncated = _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+		// The fractional part is exact
+		Avx2::Vector fraction = MathInternals::Simd::Abs<Avx2>(Avx2::Sub(x, truncated));
+		Avx2::Vector away = Avx2::Add(truncated, Avx2::Or(Avx2::Set(1.0), Avx2::And(x, Avx2::Set(-0.0))));
+
+		return Avx2::Select(Avx2::GreaterEqual(fraction, Avx2::Set(0.5)), away, truncated);
+	}
+
+}
+
+const MathInternals::KernelTable MathInternals::g_avx2Kernels =
+{
+	/* Basic operators */
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Add<Avx2>>,
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Sub<Avx2>>,
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Mul<Avx2>>,
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Div<Avx2>>,
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Neg<Avx2>>,
+
+	/* Power and exponentials */
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Sqrt<Avx2>>,
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Exp<Avx2>>,
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Ln<Avx2>>,
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Pow<Avx2>>,
+
+	/* Trigonometry */
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Sin<Avx2>>,
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Cos<Avx2>>,
+
+	/* Number functions */
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Max<Avx2>>,
+	MathInternals::Simd::BinaryKernel<Avx2, MathInternals::Simd::Min<Avx2>>,
+	MathInternals::Simd::UnaryKernel<Avx2, MathInternals::Simd::Abs<Avx2>>,
+	MathInternals::Simd::UnaryKernel<Avx2, Round>,
+	MathInternals::Simd::UnaryKernel<Avx2, Ceil>,
+	MathInternals::Simd::UnaryKernel<Avx2, Floor>,
+
+	// The remainder has no exact vectorized form, the portable loop is used
+	nullptr
+};
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#else
+
+const MathInternals::KernelTable MathInternals::g_avx2Kernels = { };
+
+#endif
\ No newline at end of file
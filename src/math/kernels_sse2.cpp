@@ -0,0 +1,127 @@
+#include "kernels.h"
+
+#if defined(MATHEVALUATOR_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+
+#include <emmintrin.h>
+
+#include "simd.h"
+
+namespace
+{
+
+	// Lane-wise primitives of SSE2, two lanes per vector
+	struct Sse2
+	{
+		using Vector = __m128d;
+		using Integer = __m128i;
+
+		static constexpr std::size_t Width = 2u;
+
+		static Vector Load(const double *values) { return _mm_loadu_pd(values); }
+
+		static void Store(double *values, Vector x) { _mm_storeu_pd(values, x); }
+
+		static Vector Set(double x) { return _mm_set1_pd(x); }
+
+		static Integer SetInteger(long long x) { return _mm_set1_epi64x(x); }
+
+		static Vector Add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+
+		static Vector Sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+
+		static Vector Mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+
+		static Vector Div(Vector a, Vector b) { return _mm_div_pd(a, b); }
+
+		// No fused multiply-add, rounds twice
+		static Vector MulAdd(Vector a, Vector b, Vector c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+
+		static Vector Sqrt(Vector x) { return _mm_sqrt_pd(x); }
+
+		static Vector Max(Vector a, Vector b) { return _mm_max_pd(a, b); }
+
+		static Vector Min(Vector a, Vector b) { return _mm_min_pd(a, b); }
+
+		static Vector And(Vector a, Vector b) { return _mm_and_pd(a, b); }
+
+		static Vector Or(Vector a, Vector b) { return _mm_or_pd(a, b); }
+
+		static Vector Xor(Vector a, Vector b) { return _mm_xor_pd(a, b); }
+
+		// ~a & b
+		static Vector AndNot(Vector a, Vector b) { return _mm_andnot_pd(a, b); }
+
+		static Vector Equal(Vector a, Vector b) { return _mm_cmpeq_pd(a, b); }
+
+		static Vector Less(Vector a, Vector b) { return _mm_cmplt_pd(a, b); }
+
+		static Vector LessEqual(Vector a, Vector b) { return _mm_cmple_pd(a, b); }
+
+		static Vector GreaterEqual(Vector a, Vector b) { return _mm_cmpge_pd(a, b); }
+
+		static Vector Select(Vector mask, Vector a, Vector b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+
+		static bool All(Vector mask) { return _mm_movemask_pd(mask) == 0x3; }
+
+		static Integer AsInteger(Vector x) { return _mm_castpd_si128(x); }
+
+		static Vector AsVector(Integer x) { return _mm_castsi128_pd(x); }
+
+		static Integer AddInteger(Integer a, Integer b) { return _mm_add_epi64(a, b); }
+
+		template<int Bits>
+		static Integer ShiftLeft(Integer x) { return _mm_slli_epi64(x, Bits); }
+
+		template<int Bits>
+		static Integer ShiftRight(Integer x) { return _mm_srli_epi64(x, Bits); }
+
+		// Lanes where all of the bits are set, bits have to be within the low 32 bits
+		static Vector TestBits(Integer x, long long bits)
+		{
+			Integer mask = _mm_set1_epi64x(bits);
+			Integer equal = _mm_cmpeq_epi32(_mm_and_si128(x, mask), mask);
+
+			// Only the low halves of the lanes are compared
+			return _mm_castsi128_pd(_mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 2, 0, 0)));
+		}
+	};
+
+}
+
+const MathInternals::KernelTable MathInternals::g_sse2Kernels =
+{
+	/* Basic operators */
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Add<Sse2>>,
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Sub<Sse2>>,
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Mul<Sse2>>,
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Div<Sse2>>,
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Neg<Sse2>>,
+
+	/* Power and exponentials */
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Sqrt<Sse2>>,
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Exp<Sse2>>,
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Ln<Sse2>>,
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Pow<Sse2>>,
+
+	/* Trigonometry */
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Sin<Sse2>>,
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Cos<Sse2>>,
+
+	/* Number functions */
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Max<Sse2>>,
+	MathInternals::Simd::BinaryKernel<Sse2, MathInternals::Simd::Min<Sse2>>,
+	MathInternals::Simd::UnaryKernel<Sse2, MathInternals::Simd::Abs<Sse2>>,
+	// Rounding instructions require SSE4.1
+	nullptr,
+	nullptr,
+	nullptr,
+
+	// The remainder has no exact vectorized form, the portable loop is used
+	nullptr
+};
+
+#else
+
+const MathInternals::KernelTable MathInternals::g_sse2Kernels = { };
+
+#endif
\ No newline at end of file
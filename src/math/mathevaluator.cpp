@@ -1,12 +1,18 @@
 #include "mathevaluator.h"
 
+#include <algorithm>
 #include <cctype>
-#include <clocale>
+#include <charconv>
+#include <deque>
+#include <iterator>
+#include <memory>
 #include <string>
-#include <sstream>
+#include <ostream>
 #include <stack>
-#include <queue>
+#include <vector>
 
+#include "arena.h"
+#include "instrumentation.h"
 #include "internals.h"
 
 static bool isNumber(unsigned char token);
@@ -15,6 +21,14 @@ static bool isWhitespace(unsigned char token);
 static bool isArgumentSeparator(unsigned char token);
 static bool isArbitraryChar(unsigned char token);
 static bool isNegation(unsigned char token);
+static bool isDigitSeparator(unsigned char token);
+static char *formatNumber(char *first, char *last, MathInternals::NumberType value, std::size_t precision);
+static std::size_t scanNumber(std::string_view input, std::size_t start, MathInternals::NumberType &value);
+static bool parseDefinition(std::string_view input, std::string_view &name, std::vector<std::string> &parameters, std::string_view &body);
+static bool parseFormula(std::string_view input, std::string_view &name, std::string_view &body);
+static std::size_t readName(std::string_view input, std::size_t start, std::string_view &name);
+static std::size_t skipWhitespace(std::string_view input, std::size_t start);
+static MathExpressions::CompiledExpression compile(std::string_view input, const MathInternals::State *state);
 
 void MathExpressions::Result::SetResult(MathInternals::NumberType result)
 {
@@ -32,23 +46,60 @@ MathInternals::NumberType MathExpressions::Result::Get()
 }
 */
 
-std::string MathExpressions::Result::GetString(std::size_t precision)
+// Formats a number without timing it, both overloads of GetString time themselves
+static std::string formatString(MathInternals::NumberType value, std::size_t precision)
 {
-	std::string res;
+	char buffer[64];
+	char *end = formatNumber(buffer, buffer + sizeof(buffer), value, precision);
+	if (end != nullptr)
+		return std::string(buffer, end);
+
+	// Large precisions, the text is never longer than the digits and a few characters
+	std::string res(precision + 32u, '\0');
+	end = formatNumber(&res[0], &res[0] + res.size(), value, precision);
+	res.resize(end - &res[0]);
+	return res;
+}
+
+std::string MathExpressions::Result::GetString(std::size_t precision) const
+{
+	MATHEVALUATOR_TIMER(formatTime);
+
+	if (m_bError)
+		return "Error";
+
+	return formatString(m_result, precision);
+}
+
+std::size_t MathExpressions::Result::GetString(char *buffer, std::size_t length, std::size_t precision) const
+{
+	MATHEVALUATOR_TIMER(formatTime);
+
+	if (length == 0u)
+		return m_bError ? std::string_view("Error").size() : formatString(m_result, precision).size();
 
 	if (m_bError)
 	{
-		res = "Error";
+		const std::string_view error = "Error";
+		std::size_t count = std::min(error.size(), length - 1u);
+		std::copy(error.begin(), error.begin() + count, buffer);
+		buffer[count] = '\0';
+		return error.size();
 	}
-	else
+
+	// Formatted in place if the text fits
+	char *end = formatNumber(buffer, buffer + length - 1u, m_result, precision);
+	if (end != nullptr)
 	{
-		std::ostringstream ss;
-		ss.precision(precision);
-		ss << m_result;
-		res = ss.str();
+		*end = '\0';
+		return static_cast<std::size_t>(end - buffer);
 	}
 
-	return res;
+	std::string text = formatString(m_result, precision);
+	std::size_t count = std::min(text.size(), length - 1u);
+	std::copy(text.begin(), text.begin() + count, buffer);
+	buffer[count] = '\0';
+	return text.size();
 }
 
 std::ostream& MathExpressions::operator<<(std::ostream &os, const MathExpressions::Result& obj)
@@ -61,119 +112,125 @@ std::ostream& MathExpressions::operator<<(std::ostream &os, const MathExpression
 	return os;
 }
 
-MathExpressions::Result MathExpressions::Evaluate(std::string input, MathInternals::State *state)
+// Call of a user-defined function on the operator stack
+struct FunctionCall
+{
+	MathInternals::Operator op;
+	const MathInternals::State::Function *function;
+};
+
+MathExpressions::CompiledExpression MathExpressions::Compile(std::string_view input, const MathInternals::State *state)
 {
 	if (input.size() == 0)
-		return MathExpressions::Result();
+		return MathExpressions::CompiledExpression();
 
-	// Fraction delimiter should be a dot
-	// Save the current locale and set it to the "C" locale
-	char *lastLocale;
-	{
-		const char *pLastLocale = std::setlocale(LC_NUMERIC, nullptr);
-		std::size_t length = std::strlen(pLastLocale) + 1;
-		lastLocale = new char[length];
-		strcpy_s(lastLocale, length, pLastLocale);
-	}
-	std::setlocale(LC_NUMERIC, "C");
+	MATHEVALUATOR_TIMER(parseTime);
+	MATHEVALUATOR_COUNT(compilations, 1u);
+
+	// Temporaries are allocated from the arena of the thread
+	MathInternals::ArenaScope arenaScope;
 
 /*
 	const std::size_t opsLength = MathInternals::g_vOperators.size();
 	const std::size_t constsLength = MathInternals::g_vConstants.size();
 */
 
-	MathExpressions::Result res;
-
 	bool bMalformed = false;
 
 	// Rewrite the expression in reverse Polish notation
 	// Shunting-yard algorithm
 
-	std::stack<MathInternals::Operator*> ops;
-	std::queue<MathInternals::Token*> output;
+	std::shared_ptr<MathInternals::Program> program = std::make_shared<MathInternals::Program>();
+	MATHEVALUATOR_COUNT(allocations, 1u);
+
+	MathInternals::ArenaStack<MathInternals::Operator*> ops;
+	MathInternals::Program &output = *program;
 
 	std::size_t offset = 0;
-	bool inNumber = false;
-	bool isFractional = false;
 	bool inCharSequence = false;
+	const MathInternals::SymbolTrie &symbols = MathInternals::SymbolTrie::Get();
+	MathInternals::SymbolTrie::Node symbol = MathInternals::SymbolTrie::Root;
 	bool lastOperator = true;
-	std::stack<MathInternals::NumberType> negations;
-	bool assigningVar = false;
+	MathInternals::ArenaStack<MathInternals::NumberType> negations;
 	
 	const std::size_t length = input.length();
-	unsigned char token;
-	for (std::size_t n = 0; n < length; n++)
-	{
-		token = input[n];
 
-		if (inNumber)
-		{
-			if (!isNumber(token))
-			{
-				if (isDelimiter(token))
-				{
-					if (isFractional)
-					{
-						// Cannot have multiple fraction delimiters inside the same number
-						bMalformed = true;
-						break;
-					}
+	// Operators standing for the functions of the state, one for every function that is called
+	// Stored in a deque to keep their addresses on the operator stack
+	std::deque<FunctionCall, MathInternals::ArenaAllocator<FunctionCall>> calls;
 
-					isFractional = true;
-					continue;
-				}
+	// Names followed by a parenthesis are calls if the state has a function of that name
+	auto findFunction = [&](std::string_view name, std::size_t next) -> MathInternals::Operator*
+	{
+		if (state == nullptr || !state->HasFunctions())
+			return nullptr;
 
-				inNumber = false;
-				isFractional = false;
-				lastOperator = false;
-				
-				MathInternals::NumberType value;
-				try
-				{
-					value = static_cast<MathInternals::NumberType>(std::stod(input.substr(offset, n - offset)));
-				}
-				catch (...)
-				{
-					bMalformed = true;
-					break;
-				}
+		while (next < length && isWhitespace(input[next]))
+			next++;
+		if (next == length || input[next] != '(')
+			return nullptr;
 
-				MathInternals::Operand *arg = new MathInternals::Operand(value);
-				output.push(arg);
+		const MathInternals::State::Function *function = state->FindFunction(name);
+		if (function == nullptr)
+			return nullptr;
 
-				if (!negations.empty() && negations.top() == 1)
-				{
-					output.push(&MathInternals::g_negation);
-					negations.pop();
-				}
+		for (FunctionCall &call : calls)
+		{
+			if (call.function == function)
+				return &call.op;
+		}
 
-				offset = n;
+		calls.push_back({ MathInternals::Operator(std::string(name), static_cast<uint8_t>(function->parameters.size()), MathInternals::FunctionPrecedence, true, nullptr), function });
+		return &calls.back().op;
+	};
 
-				goto skip_number_check;
-			}
-			else
+	// Calls of user-defined functions are inlined
+	auto pushOperator = [&](MathInternals::Operator *op)
+	{
+		for (const FunctionCall &call : calls)
+		{
+			if (&call.op == op)
 			{
-				continue;
+				output.PushFunction(*call.function);
+				return;
 			}
 		}
 
+		output.PushOperator(op);
+	};
+
+	unsigned char token;
+	for (std::size_t n = 0; n < length; n++)
+	{
+		token = input[n];
+
 		if (isNumber(token))
 		{
-			if (assigningVar)
+			// The whole literal is read at once
+			MathInternals::NumberType value;
+			std::size_t end = scanNumber(input, n, value);
+			if (end == std::string_view::npos)
 			{
 				bMalformed = true;
 				break;
 			}
 
-			inNumber = true;
-			offset = n;
+			output.PushNumber(value);
+			lastOperator = false;
+
+			if (!negations.empty() && negations.top() == 1)
+			{
+				output.PushOperator(&MathInternals::g_negation);
+				negations.pop();
+			}
+
+			n = end - 1;
 			continue;
 		}
 
 		if (!inCharSequence)
 			offset = n;
 
-skip_number_check:
 		if (isWhitespace(token) || isArgumentSeparator(token))
 		{
 			if (inCharSequence)
@@ -184,7 +241,16 @@ skip_number_check:
 			}
 
 			if (isArgumentSeparator(token))
+			{
+				// The previous argument is complete, including calls inside of it
+				while (!ops.empty() && ops.top() != &MathInternals::g_leftParen)
+				{
+					pushOperator(ops.top());
+					ops.pop();
+				}
+
 				lastOperator = true;
+			}
 
 			offset = n;
 			continue;
@@ -197,19 +263,18 @@ skip_number_check:
 		if (token == '=')
 		{
 			lastOperator = true;
-			assigningVar = false;
 
 			while (!ops.empty() && (
 				(ops.top()->GetPrecedence() > MathInternals::g_assignment.GetPrecedence()) ||
 				((ops.top()->GetPrecedence() == MathInternals::g_assignment.GetPrecedence()) && ops.top()->IsLeftAssociate())
 			))
 			{
-				output.push(ops.top());
+				pushOperator(ops.top());
 				ops.pop();
 			}
 			ops.push(&MathInternals::g_assignment);
 
-			// output.push(&MathInternals::g_assignment);
+			// output.PushOperator(&MathInternals::g_assignment);
 
 			offset = n;
 			continue;
@@ -237,10 +302,9 @@ skip_number_check:
 		}
 		else if (token == ')')
 		{
-			bool bFoundParen = false;
 			while (!ops.empty() && ops.top()->GetName() != "(")
 			{
-				output.push(ops.top());
+				pushOperator(ops.top());
 				ops.pop();
 			}
 			if (ops.empty() || ops.top()->GetName() != "(")
@@ -258,11 +322,11 @@ skip_number_check:
 					// Warning: Might be incorrect, not a part of the algorithm
 					if (!ops.empty() && ops.top()->GetPrecedence() == MathInternals::FunctionPrecedence)
 					{
-						output.push(ops.top());
+						pushOperator(ops.top());
 						ops.pop();
 					}
 
-					output.push(&MathInternals::g_negation);
+					output.PushOperator(&MathInternals::g_negation);
 					negations.pop();
 				}
 				else if (negations.top() > 0)
@@ -284,9 +348,12 @@ skip_number_check:
 		{
 			inCharSequence = true;
 			offset = n;
+			symbol = MathInternals::SymbolTrie::Root;
 		}
 
-		// ToDo: Optimize
+		// Names of operators and constants are resolved while the sequence is read
+		symbol = symbols.Next(symbol, token);
+
 		if (isArbitraryChar(token) && (n != (length - 1)) && isArbitraryChar(input[n + 1]))
 			continue;
 
@@ -298,81 +365,39 @@ skip_number_check:
 			continue;
 		}
 
-		std::string_view substring(input.c_str() + offset, n - offset + 1);
+		MathInternals::Operator* opMatch = symbols.GetOperator(symbol);
+		if (opMatch == nullptr)
+			opMatch = findFunction(input.substr(offset, n - offset + 1), n + 1);
 
-		MathInternals::Operator* opMatch = nullptr;
-		for (MathInternals::Operator& op : MathInternals::g_vOperators)
+		if (opMatch != nullptr)
 		{
-			if (op.GetName() == substring)
-			{
-				opMatch = &op;
-				inCharSequence = false;
-				lastOperator = true;
-				break;
-			}
+			inCharSequence = false;
+			lastOperator = true;
 		}
-
-		if (opMatch == nullptr)
+		else
 		{
-			MathInternals::Token* variableMatch = nullptr;
-			for (std::pair<std::string, MathInternals::NumberType>& item : MathInternals::g_vConstants)
-			{
-				if (item.first == substring)
-				{
-					variableMatch = new MathInternals::Operand(item.second);
-					output.push(variableMatch);
-
-					inCharSequence = false;
-					lastOperator = false;
-
-					if (!negations.empty() && negations.top() == 1)
-					{
-						output.push(&MathInternals::g_negation);
-						negations.pop();
-					}
+			const MathInternals::NumberType *constant = symbols.GetConstant(symbol);
 
-					offset = n;
-					break;
-				}
+			if (constant != nullptr)
+			{
+				output.PushNumber(*constant);
 			}
-
-			if (variableMatch != nullptr)
-				continue;
-
-			// ToDo: Refactor code 
-			if (state != nullptr && !state->empty())
+			else
 			{
-				for (std::pair<std::string, MathInternals::NumberType>& item : *state)
-				{
-					if (item.first == substring)
-					{
-						variableMatch = new MathInternals::Variable(substring, item.second);
-						output.push(variableMatch);
-
-						inCharSequence = false;
-						lastOperator = false;
-
-						if (!negations.empty() && negations.top() == 1)
-						{
-							output.push(&MathInternals::g_negation);
-							negations.pop();
-						}
-
-						offset = n;
-						break;
-					}
-				}
+				// Variables are resolved against the state during evaluation
+				output.PushVariable(input.substr(offset, n - offset + 1));
 			}
 
-			if (variableMatch == nullptr)
-			{
-				inCharSequence = false;
-				assigningVar = true;
+			inCharSequence = false;
+			lastOperator = false;
 
-				MathInternals::Variable *var = new MathInternals::Variable(substring);
-				output.push(var);
+			if (!negations.empty() && negations.top() == 1)
+			{
+				output.PushOperator(&MathInternals::g_negation);
+				negations.pop();
 			}
 
+			offset = n;
 			continue;
 		}
 
@@ -381,7 +406,7 @@ skip_number_check:
 			((ops.top()->GetPrecedence() == opMatch->GetPrecedence()) && ops.top()->IsLeftAssociate())
 		))
 		{
-			output.push(ops.top());
+			pushOperator(ops.top());
 			ops.pop();
 		}
 		ops.push(opMatch);
@@ -392,36 +417,7 @@ skip_number_check:
 	if (bMalformed)
 		goto postfix_done;
 
-	// ToDo: Refactor code duplication
-	if (inNumber)
-	{
-		if (!isNumber(token))
-		{
-			bMalformed = true;
-			goto postfix_done;
-		}
-
-		MathInternals::NumberType value;
-		try
-		{
-			value = static_cast<MathInternals::NumberType>(std::stod(input.substr(offset, length - offset + 1)));
-
-			MathInternals::Operand *arg = new MathInternals::Operand(value);
-			output.push(arg);
-
-			if (!negations.empty() && negations.top() == 1)
-			{
-				output.push(&MathInternals::g_negation);
-				negations.pop();
-			}
-		}
-		catch (...)
-		{
-			bMalformed = true;
-		}
-	}
-
-	if (inCharSequence || !negations.empty() || assigningVar)
+	if (inCharSequence || !negations.empty())
 	{
 		bMalformed = true;
 		goto postfix_done;
@@ -436,167 +432,255 @@ postfix_done:
 			if (op == &MathInternals::g_leftParen)
 				bMalformed = true;
 			if (!bMalformed)
-				output.push(op);
+				pushOperator(op);
 			ops.pop();
 		}
 	}
 
+	if (bMalformed || !program->IsComplete())
+		return MathExpressions::CompiledExpression();
+
+	MATHEVALUATOR_TIMER_STOP(parseTime);
+
+	program->Optimize();
+	MATHEVALUATOR_COUNT(instructions, program->GetInstructions().size());
+
+	return MathExpressions::CompiledExpression(program);
+}
+
+MathExpressions::Result MathExpressions::CompiledExpression::Evaluate(MathInternals::State *state) const
+{
+	if (Error())
+		return MathExpressions::Result();
+
+	MATHEVALUATOR_TIMER(executeTime);
+	MATHEVALUATOR_COUNT(evaluations, 1u);
+	MATHEVALUATOR_COUNT(executedInstructions, m_program->GetInstructions().size());
+
 	// Reverse Polish evaluation
-	std::stack<MathInternals::Operand*> evalStack;
+	// Common expressions are evaluated without any heap allocations
+	MathInternals::Value localStack[MathInternals::LocalStackSize];
+	std::unique_ptr<MathInternals::Value[]> heapStack;
 
-	if (bMalformed)
-		goto function_end;
+	MathInternals::Value *evalStack = localStack;
+	if (m_program->GetStackSize() > MathInternals::LocalStackSize)
+	{
+		heapStack.reset(new MathInternals::Value[m_program->GetStackSize()]);
+		MATHEVALUATOR_COUNT(allocations, 1u);
+		evalStack = heapStack.get();
+	}
 
-	while (output.size() != 0)
+	// The program has been validated by Compile(), every operator has enough operands
+	const MathInternals::Program &program = *m_program;
+	std::size_t top = 0;
+	for (const MathInternals::Instruction &instruction : program.GetInstructions())
 	{
-		union
+		switch (instruction.code)
 		{
-			MathInternals::Token *tk;
-			MathInternals::Operator *op;
-			MathInternals::Operand *arg;
-			MathInternals::Variable *var;
-		};
-		tk = output.front();
-		
-		if (tk->IsOperator())
+		case MathInternals::OpCode::Number:
+			evalStack[top++] = { program.GetNumber(instruction.index), MathInternals::Value::NoVariable, true };
+			break;
+
+		case MathInternals::OpCode::Variable:
 		{
-			op = static_cast<MathInternals::Operator*>(tk);
+			// Variables that are not defined yet can only be assigned to
+			MathInternals::Value &value = evalStack[top++];
+			value = { 0, instruction.index, false };
 
-			if (op == &MathInternals::g_assignment)
+			const MathInternals::NumberType *bound = GetBinding(instruction.index);
+			if (bound != nullptr)
 			{
-				if (2u > evalStack.size())
-				{
-					bMalformed = true;
-					goto function_end;
-				}
-
-				MathInternals::Operand *operand = evalStack.top();
-				/*
-				if (operand->IsVariable())
-				{
-					bMalformed = true;
-					goto function_end;
-				}
-				*/
-				evalStack.pop();
-
-				MathInternals::Operand *variable = evalStack.top();
-				if (!variable->IsVariable())
-				{
-					bMalformed = true;
-					goto function_end;
-				}
-				evalStack.pop();
-				std::string name = static_cast<MathInternals::Variable*>(variable)->GetName();
-				delete variable;
-
-				MathInternals::Operand *evaluated = new MathInternals::Operand(MathInternals::g_assignment.Evaluate(*state, name, operand).GetValue());
-				evalStack.push(evaluated);
+				value.number = *bound;
+				value.defined = true;
 			}
-			else
+			else if (state != nullptr)
 			{
-				std::stack<MathInternals::Operand*> args;
-				uint8_t numArgs = op->GetNumOperands();
-				if (numArgs > evalStack.size())
+				MathInternals::State::Slot slot = state->Find(program.GetVariable(instruction.index));
+				if (slot != MathInternals::State::InvalidSlot)
 				{
-					bMalformed = true;
-					goto function_end;
+					value.number = state->GetValue(slot);
+					value.defined = true;
 				}
-
-				for (uint8_t i = 0; i < numArgs; i++)
-				{
-					if (evalStack.top()->IsVariable())
-					{
-						MathInternals::Variable* var = static_cast<MathInternals::Variable*>(evalStack.top());
-						if (!var->IsInitialized())
-						{
-							bMalformed = true;
-							delete var;
-							goto function_end;
-						}
-
-						args.push(new MathInternals::Operand(var->GetValue()));
-						delete var;
-					}
-					else
-					{
-						args.push(evalStack.top());
-					}
-					evalStack.pop();
-				}
-				evalStack.push(new MathInternals::Operand(op->Evaluate(args).GetValue()));
 			}
+			break;
 		}
-		else
+
+		case MathInternals::OpCode::Copy:
 		{
-			arg = static_cast<MathInternals::Operand*>(tk);
-			evalStack.push(arg);
+			const MathInternals::Value &argument = evalStack[instruction.index];
+			evalStack[top++] = { argument.number, MathInternals::Value::NoVariable, argument.defined };
+			break;
 		}
 
-		output.pop();
-	}
-	
-	if (evalStack.size() != 1)
-	{
-		bMalformed = true;
+		case MathInternals::OpCode::Squash:
+		{
+			top -= instruction.index;
+			MathInternals::Value &result = evalStack[top - 1];
+			result = evalStack[top - 1 + instruction.index];
+			result.variable = MathInternals::Value::NoVariable;
+			break;
+		}
+
+		case MathInternals::OpCode::Assign:
+		{
+			MathInternals::Value &variable = evalStack[top - 2];
+			MathInternals::Value &operand = evalStack[top - 1];
+			if (state == nullptr || variable.variable == MathInternals::Value::NoVariable || !operand.defined)
+				return MathExpressions::Result();
+
+			variable.number = MathInternals::g_assignment.Evaluate(*state, program.GetVariable(variable.variable), operand.number);
+			variable.variable = MathInternals::Value::NoVariable;
+			variable.defined = true;
+			top--;
+			break;
+		}
 
-		MathInternals::Operand* arg;
-		do
+		case MathInternals::OpCode::Add:
+		case MathInternals::OpCode::Subtract:
+		case MathInternals::OpCode::Multiply:
+		case MathInternals::OpCode::Divide:
 		{
-			arg = evalStack.top();
-			delete arg;
+			MathInternals::Value &left = evalStack[top - 2];
+			MathInternals::Value &right = evalStack[top - 1];
+			if (!left.defined || !right.defined)
+				return MathExpressions::Result();
+
+			if (instruction.code == MathInternals::OpCode::Add)
+				left.number += right.number;
+			else if (instruction.code == MathInternals::OpCode::Subtract)
+				left.number -= right.number;
+			else if (instruction.code == MathInternals::OpCode::Multiply)
+				left.number *= right.number;
+			else
+				left.number /= right.number;
 
-			evalStack.pop();
+			left.variable = MathInternals::Value::NoVariable;
+			top--;
+			break;
 		}
-		while (evalStack.size() != 0);
 
-		goto function_end;
-	}
+		case MathInternals::OpCode::Negate:
+		{
+			MathInternals::Value &operand = evalStack[top - 1];
+			if (!operand.defined)
+				return MathExpressions::Result();
 
-	// Set the result value
-	{
-		MathInternals::Operand* arg;
-		arg = evalStack.top();
+			operand.number = -operand.number;
+			operand.variable = MathInternals::Value::NoVariable;
+			break;
+		}
 
-		if (arg->IsVariable())
+		case MathInternals::OpCode::Call:
 		{
-			MathInternals::Variable* var = static_cast<MathInternals::Variable*>(evalStack.top());
-			if (!var->IsInitialized())
+			MathInternals::Operator *op = program.GetOperator(instruction.index);
+			uint8_t numArgs = op->GetNumOperands();
+
+			MathInternals::NumberType args[MathInternals::MaxOperands];
+			for (uint8_t i = 0; i < numArgs; i++)
 			{
-				bMalformed = true;
-				delete var;
-				goto function_end;
+				MathInternals::Value &arg = evalStack[top - numArgs + i];
+				if (!arg.defined)
+					return MathExpressions::Result();
+
+				args[i] = arg.number;
 			}
 
-			res.SetResult(var->GetValue());
-			delete var;
+			top -= numArgs;
+			evalStack[top++] = { op->Evaluate(args), MathInternals::Value::NoVariable, true };
+			break;
 		}
-		else
-		{
-			res.SetResult(arg->GetValue());
-			delete arg;
 		}
 	}
 
-function_end:
-	// Free all allocated memory
-	{
-		MathInternals::Token* tk;
+	if (!evalStack[0].defined)
+		return MathExpressions::Result();
+
+	return MathExpressions::Result(evalStack[0].number);
+}
+
+MathInternals::NumberType *MathExpressions::CompiledExpression::Bind(std::string_view name)
+{
+	std::ptrdiff_t variable = FindVariable(name);
+	if (variable < 0)
+		return nullptr;
+
+	m_vBindings[variable] = { true, nullptr };
+	return &m_vSlots[variable];
+}
+
+bool MathExpressions::CompiledExpression::Bind(std::string_view name, const MathInternals::NumberType *memory)
+{
+	std::ptrdiff_t variable = FindVariable(name);
+	if (variable < 0)
+		return false;
+
+	m_vBindings[variable] = { true, memory };
+	return true;
+}
+
+void MathExpressions::CompiledExpression::Unbind(std::string_view name)
+{
+	std::ptrdiff_t variable = FindVariable(name);
+	if (variable >= 0)
+		m_vBindings[variable] = { false, nullptr };
+}
+
+std::ptrdiff_t MathExpressions::CompiledExpression::FindVariable(std::string_view name)
+{
+	if (Error())
+		return -1;
 
-		while (output.size() != 0)
+	const std::vector<std::string> &variables = m_program->GetVariables();
+	for (std::size_t i = 0; i < variables.size(); i++)
+	{
+		if (variables[i] == name)
 		{
-			tk = output.front();
-			if (!tk->IsOperator())
-				delete tk;
+			// Slots are only allocated by expressions that bind variables
+			if (m_vBindings.empty())
+			{
+				m_vSlots.assign(variables.size(), 0);
+				m_vBindings.assign(variables.size(), { false, nullptr });
+			}
 
-			output.pop();
+			return static_cast<std::ptrdiff_t>(i);
 		}
 	}
 
-	// Restore the original locale
-	std::setlocale(LC_NUMERIC, lastLocale);
-	delete[] lastLocale;
+	return -1;
+}
+
+MathExpressions::Result MathExpressions::Evaluate(std::string_view input, MathInternals::State *state)
+{
+	MATHEVALUATOR_CALL_BEGIN();
+
+	MathExpressions::Result res;
+	std::string_view name;
+	std::string_view body;
+	std::vector<std::string> parameters;
+	if (state != nullptr && parseDefinition(input, name, parameters, body))
+	{
+		// The body is compiled once, calls do not parse it again
+		MathExpressions::CompiledExpression function = MathExpressions::Compile(body, state);
+		if (!function.Error())
+		{
+			state->SetFunction(name, { function.GetProgram(), std::move(parameters) });
+			res.SetResult(0);
+		}
+	}
+	else if (state != nullptr && state->IsReactive() && parseFormula(input, name, body))
+	{
+		// The formula is kept by the state to be recomputed when its inputs change
+		MathExpressions::CompiledExpression formula = compile(body, state);
+		res = formula.Evaluate(state);
+		if (!res.Error() && !state->SetFormula(name, formula.GetProgram(), res.Get()))
+			res = MathExpressions::Result();
+	}
+	else
+	{
+		res = compile(input, state).Evaluate(state);
+	}
 
+	MATHEVALUATOR_CALL_END();
 	return res;
 }
 
@@ -666,4 +750,237 @@ static bool isNegation(unsigned char token)
 	// ToDo: Implement other encodings
 
 	return token == '-';
+}
+
+static bool isDigitSeparator(unsigned char token)
+{
+	// Assumes ASCII
+	// ToDo: Implement other encodings
+
+	return token == '\'' || token == '_';
+}
+
+// Reads a number literal starting at the given digit, returns the index past its end
+// Decimal numbers may have a fraction and an exponent (1.5e-9), hexadecimal integers start with 0x (0x1F)
+// Digit separators are allowed between digits (1'000'000, 1_000)
+// Returns npos if the literal is malformed
+static std::size_t scanNumber(std::string_view input, std::size_t start, MathInternals::NumberType &value)
+{
+	const std::size_t length = input.length();
+	std::size_t n = start;
+	bool hexadecimal = false;
+	bool separators = false;
+
+	if (input[n] == '0' && n + 2 < length && (input[n + 1] == 'x' || input[n + 1] == 'X') && std::isxdigit(static_cast<unsigned char>(input[n + 2])))
+	{
+		hexadecimal = true;
+		n += 2;
+	}
+
+	const std::size_t first = n;
+
+	auto isDigit = [hexadecimal](unsigned char token)
+	{
+		return hexadecimal ? std::isxdigit(token) != 0 : isNumber(token);
+	};
+
+	auto skipDigits = [&]()
+	{
+		for (bool bDigits = false; n < length; n++)
+		{
+			unsigned char token = input[n];
+			if (isDigit(token))
+			{
+				bDigits = true;
+				continue;
+			}
+
+			// Separators only stand between two digits
+			if (bDigits && isDigitSeparator(token) && n + 1 < length && isDigit(input[n + 1]))
+			{
+				separators = true;
+				continue;
+			}
+
+			break;
+		}
+	};
+
+	skipDigits();
+
+	if (!hexadecimal)
+	{
+		if (n < length && isDelimiter(input[n]))
+		{
+			n++;
+			skipDigits();
+		}
+
+		// Only an exponent if digits follow, 2e is the number 2 followed by the constant e
+		if (n < length && (input[n] == 'e' || input[n] == 'E'))
+		{
+			std::size_t exponent = n + 1;
+			if (exponent < length && (input[exponent] == '+' || input[exponent] == '-'))
+				exponent++;
+
+			if (exponent < length && isNumber(input[exponent]))
+			{
+				n = exponent;
+				skipDigits();
+			}
+		}
+	}
+
+	// Cannot have multiple fraction delimiters inside the same number
+	if (n < length && isDelimiter(input[n]))
+		return std::string_view::npos;
+
+	const char *begin = input.data() + first;
+	const char *end = input.data() + n;
+
+	// Separators are removed in a copy
+	MathInternals::ArenaVector<char> digits;
+	if (separators)
+	{
+		digits.reserve(n - first);
+		std::copy_if(begin, end, std::back_inserter(digits), [](char token) { return !isDigitSeparator(token); });
+
+		begin = digits.data();
+		end = digits.data() + digits.size();
+	}
+
+	// Does not depend on the current locale, fraction delimiter is always a dot
+	double number;
+	std::from_chars_result res = std::from_chars(begin, end, number, hexadecimal ? std::chars_format::hex : std::chars_format::general);
+	if (res.ec != std::errc() || res.ptr != end)
+		return std::string_view::npos;
+
+	value = static_cast<MathInternals::NumberType>(number);
+	return n;
+}
+
+// Recognizes definitions of functions, such as f(x, y) = x^2 + y
+// Returns false if the input is not a definition
+static bool parseDefinition(std::string_view input, std::string_view &name, std::vector<std::string> &parameters, std::string_view &body)
+{
+	if (input.find('=') == std::string_view::npos)
+		return false;
+
+	const std::size_t length = input.length();
+	std::size_t n = readName(input, 0, name);
+	if (n == std::string_view::npos)
+		return false;
+
+	n = skipWhitespace(input, n);
+	if (n == length || input[n] != '(')
+		return false;
+
+	n = skipWhitespace(input, n + 1);
+	if (n < length && input[n] == ')')
+	{
+		n++;
+	}
+	else
+	{
+		for (;;)
+		{
+			std::string_view parameter;
+			n = readName(input, n, parameter);
+			if (n == std::string_view::npos)
+				return false;
+
+			if (parameters.size() == MathInternals::MaxParameters || std::find(parameters.begin(), parameters.end(), parameter) != parameters.end())
+				return false;
+			parameters.emplace_back(parameter);
+
+			n = skipWhitespace(input, n);
+			if (n == length)
+				return false;
+
+			if (isArgumentSeparator(input[n]))
+			{
+				n++;
+				continue;
+			}
+			if (input[n] != ')')
+				return false;
+
+			n++;
+			break;
+		}
+	}
+
+	n = skipWhitespace(input, n);
+	if (n == length || input[n] != '=')
+		return false;
+
+	body = input.substr(n + 1);
+	return true;
+}
+
+// Recognizes formulas assigned to a single variable, such as total = a*b + c
+// Chained assignments are not formulas, the body cannot assign variables itself
+// Returns false if the input is not a formula
+static bool parseFormula(std::string_view input, std::string_view &name, std::string_view &body)
+{
+	std::size_t n = readName(input, 0, name);
+	if (n == std::string_view::npos)
+		return false;
+
+	n = skipWhitespace(input, n);
+	if (n == input.length() || input[n] != '=')
+		return false;
+
+	body = input.substr(n + 1);
+	return body.find('=') == std::string_view::npos;
+}
+
+// Reads the name of a variable, function or parameter after any whitespace, returns the index past its end
+// Returns npos if there is no name or it belongs to an operator or a constant
+static std::size_t readName(std::string_view input, std::size_t start, std::string_view &name)
+{
+	const MathInternals::SymbolTrie &symbols = MathInternals::SymbolTrie::Get();
+	const std::size_t length = input.length();
+
+	start = skipWhitespace(input, start);
+
+	std::size_t n = start;
+	MathInternals::SymbolTrie::Node symbol = MathInternals::SymbolTrie::Root;
+	while (n < length && isArbitraryChar(input[n]) && input[n] != '=')
+		symbol = symbols.Next(symbol, input[n++]);
+
+	if (n == start || symbols.GetOperator(symbol) != nullptr || symbols.GetConstant(symbol) != nullptr)
+		return std::string_view::npos;
+
+	name = input.substr(start, n - start);
+	return n;
+}
+
+static std::size_t skipWhitespace(std::string_view input, std::size_t start)
+{
+	while (start < input.length() && isWhitespace(input[start]))
+		start++;
+
+	return start;
+}
+
+// Programs calling functions of the state are not cached, the same text compiles differently for every state
+static MathExpressions::CompiledExpression compile(std::string_view input, const MathInternals::State *state)
+{
+	if (state != nullptr && state->HasFunctions())
+		return MathExpressions::Compile(input, state);
+
+	return MathExpressions::GetExpressionCache().Get(input);
+}
+
+// Returns the end of the text, nullptr if it does not fit
+static char *formatNumber(char *first, char *last, MathInternals::NumberType value, std::size_t precision)
+{
+	std::to_chars_result res;
+	if (precision == MathInternals::ShortestPrecision)
+		res = std::to_chars(first, last, static_cast<double>(value));
+	else
+		res = std::to_chars(first, last, static_cast<double>(value), std::chars_format::general, static_cast<int>(std::min<std::size_t>(precision, 1024u)));
+
+	return res.ec == std::errc() ? res.ptr : nullptr;
 }
\ No newline at end of file
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace MathInternals
@@ -9,15 +19,150 @@ namespace MathInternals
 	// Primitive data type used internally to represent a number
 	// ToDo: Fix precision loss when using types greater than double
 	// Implementation specific, should not be relied upon
-	// Warning: 8-bit types are treated as characters in GetString()
 	using NumberType = double;
 
 	// Default precision of output in GetString()
 	constexpr std::size_t OutputPrecision = 12u;
 
+	// Precision of GetString() that gives the shortest text which reads back as the same number
+	constexpr std::size_t ShortestPrecision = 0u;
+
+	// Default number of expressions kept by an ExpressionCache
+	constexpr std::size_t CacheCapacity = 4096u;
+
+	// Default number of rows in a chunk of EvaluateBatchParallel(), a column of a chunk takes 64 KiB
+	constexpr std::size_t BatchChunkSize = 8192u;
+
+	// Postfix representation of an expression, see internals.h
+	class Program;
+
+	// Machine code generated for a program, see jit.h
+	class NativeCode;
+
 	// Type used to represent a state
-	// ToDo: Store defined functions
-	using State = std::vector<std::pair<std::string, MathInternals::NumberType>>;
+	// Not synchronized, concurrent access to the same state requires a lock
+	// Variables are stored in slots in the order of definition
+	// Names are indexed by an open addressing hash table, lookups take constant time
+	// Functions defined by the user are kept compiled, calls are inlined by Compile()
+	// In reactive mode variables assigned a formula are recomputed whenever one of their inputs changes
+	class State
+	{
+
+	public:
+		// Body of a function, refers to its parameters as variables
+		struct Function
+		{
+			std::shared_ptr<const Program> program;
+			std::vector<std::string> parameters;
+		};
+
+		// Index of a variable, stays valid for the lifetime of the state
+		using Slot = std::uint32_t;
+
+		// Program computing a variable from its inputs
+		struct Formula
+		{
+			std::shared_ptr<const Program> program;
+			std::vector<Slot> inputs;
+		};
+
+		static constexpr Slot InvalidSlot = ~static_cast<Slot>(0);
+
+		State()
+		{
+		}
+
+		// Returns InvalidSlot if the variable is not defined
+		Slot Find(std::string_view name) const;
+
+		// Defines the variable if needed, returns its slot
+		// In reactive mode the formula of the variable is removed and the formulas depending on it are recomputed
+		Slot Set(std::string_view name, NumberType value);
+
+		NumberType GetValue(Slot slot) const { return m_vValues[slot]; }
+
+		void SetValue(Slot slot, NumberType value)
+		{
+			m_vValues[slot] = value;
+			if (m_bReactive)
+				Update(slot);
+		}
+
+		const std::string &GetName(Slot slot) const { return m_vNames[slot]; }
+
+		std::size_t Size() const { return m_vNames.size(); }
+
+		bool Empty() const { return m_vNames.empty(); }
+
+		// Returns nullptr if the function is not defined
+		const Function *FindFunction(std::string_view name) const;
+
+		// Replaces the function if it is already defined, expressions compiled before keep the old body
+		void SetFunction(std::string_view name, Function function);
+
+		bool HasFunctions() const { return !m_vFunctions.empty(); }
+
+		// Formulas are only recorded in reactive mode, leaving it forgets them
+		void SetReactive(bool reactive);
+
+		bool IsReactive() const { return m_bReactive; }
+
+		// Assigns the value of the formula to the variable and records the formula in reactive mode
+		// Fails without changing anything if the variable is one of the inputs of the formula, directly or through other formulas
+		bool SetFormula(std::string_view name, std::shared_ptr<const Program> program, NumberType value);
+
+		// Returns nullptr if the variable is not computed by a formula
+		const Formula *GetFormula(Slot slot) const;
+
+		// Number of threads recomputing independent formulas at once, 0 for every hardware thread
+		// Results are the same for any number of threads
+		void SetThreads(std::size_t threads) { m_nThreads = threads; }
+
+		std::size_t GetThreads() const { return m_nThreads; }
+
+	private:
+		Slot Add(std::string_view name, NumberType value);
+
+		void Insert(Slot slot);
+
+		void Rehash(std::size_t buckets);
+
+		// Drops the formula of a variable that was given a value, recomputes the formulas depending on it
+		void Update(Slot slot);
+
+		void Recompute(Slot slot);
+
+		// Formulas are scheduled as soon as their inputs are computed, idle threads steal them from the others
+		void RecomputeParallel(std::size_t threads);
+
+		void RemoveFormula(Slot slot);
+
+		// Sizes the graph of formulas to the number of variables
+		void Reserve();
+
+		// Lists the formulas depending on the variable in m_vOrder, each one after all of its inputs
+		void SortDependents(Slot slot);
+
+		std::vector<std::string> m_vNames;
+		std::vector<std::size_t> m_vHashes;
+		std::vector<NumberType> m_vValues;
+		// Power of two number of buckets, InvalidSlot marks an empty bucket
+		std::vector<Slot> m_vBuckets;
+		std::vector<std::pair<std::string, Function>> m_vFunctions;
+
+		bool m_bReactive = false;
+		// Indexed by slot, both are empty until the first formula is recorded
+		std::vector<Formula> m_vFormulas;
+		std::vector<std::vector<Slot>> m_vDependents;
+		// Reused by SortDependents(), marks are cleared after every traversal
+		std::vector<Slot> m_vOrder;
+		std::vector<std::pair<Slot, std::size_t>> m_vPath;
+		std::vector<bool> m_vMarks;
+		// Position of a variable in m_vOrder during a parallel recomputation, InvalidSlot otherwise
+		std::vector<Slot> m_vRanks;
+		std::size_t m_nThreads = 1u;
+
+	};
 
 }
 
@@ -34,7 +179,7 @@ namespace MathExpressions
 		}
 
 		Result(MathInternals::NumberType output)
-			: m_result(output), m_bError(false)
+			: m_bError(false), m_result(output)
 		{
 		}
 
@@ -53,7 +198,12 @@ namespace MathExpressions
 			return static_cast<T>(m_result);
 		}
 
-		std::string GetString(std::size_t precision = MathInternals::OutputPrecision);
+		// Significant digits as in printf("%g"), or ShortestPrecision
+		std::string GetString(std::size_t precision = MathInternals::OutputPrecision) const;
+
+		// Writes into the buffer without allocating, the text is truncated to fit and always null-terminated
+		// Returns the length of the whole text, which did not fit if it is not less than the length of the buffer
+		std::size_t GetString(char *buffer, std::size_t length, std::size_t precision = MathInternals::OutputPrecision) const;
 
 		// operator MathInternals::NumberType() { return Get(); }
 
@@ -61,28 +211,301 @@ namespace MathExpressions
 
 	private:
 		bool m_bError = false;
-		MathInternals::NumberType m_result;
+		MathInternals::NumberType m_result = 0;
+
+	};
+
+	std::ostream& operator<<(std::ostream &os, const Result& obj);
+
+	// Expression translated into reverse Polish notation
+	// Can be evaluated any number of times without parsing the expression again
+	// Copies share the same immutable program, can be evaluated from several threads at once
+	// Variables can be bound to slots to skip looking them up by name, every copy has its own bindings
+	// Binding and writing to the slots is not synchronized with evaluation
+	class CompiledExpression
+	{
+
+	public:
+		// Warning: To be used for malformed expressions
+		CompiledExpression()
+			: m_program(nullptr)
+		{
+		}
+
+		CompiledExpression(std::shared_ptr<const MathInternals::Program> program)
+			: m_program(program)
+		{
+		}
+
+		bool Error() const { return m_program == nullptr; }
+
+		// Unbound variables are looked up in the state on every evaluation
+		Result Evaluate(MathInternals::State *state = nullptr) const;
+
+		// Binds the variable to a slot of the expression and returns it, values are written into the slot directly
+		// Slots of all the variables are contiguous, the pointer stays valid for the lifetime of the expression
+		// Returns nullptr if the expression does not use the variable
+		MathInternals::NumberType *Bind(std::string_view name);
+
+		// Reads the variable from caller-owned memory, which has to outlive the binding
+		// Returns false if the expression does not use the variable
+		bool Bind(std::string_view name, const MathInternals::NumberType *memory);
+
+		// The variable is looked up in the state again
+		void Unbind(std::string_view name);
+
+		// Implementation specific, should not be relied upon
+		const std::shared_ptr<const MathInternals::Program> &GetProgram() const { return m_program; }
+
+		// Implementation specific, should not be relied upon
+		// Value of a bound variable of the program, nullptr if it is not bound
+		const MathInternals::NumberType *GetBinding(std::size_t variable) const
+		{
+			if (m_vBindings.empty() || !m_vBindings[variable].bound)
+				return nullptr;
+
+			const MathInternals::NumberType *external = m_vBindings[variable].external;
+			return external != nullptr ? external : &m_vSlots[variable];
+		}
+
+	private:
+		struct Binding
+		{
+			bool bound;
+			// Caller-owned memory, the slot is used if nullptr
+			const MathInternals::NumberType *external;
+		};
+
+		// Index of the variable in the program, -1 if it is not used
+		// Allocates the slots when a variable is found for the first time
+		std::ptrdiff_t FindVariable(std::string_view name);
+
+		std::shared_ptr<const MathInternals::Program> m_program;
+		// One per variable of the program, allocated on the first binding
+		std::vector<MathInternals::NumberType> m_vSlots;
+		std::vector<Binding> m_vBindings;
 
 	};
 
-	Result Evaluate(std::string expression, MathInternals::State *state = nullptr);
+	// Compiled expressions keyed by their text, repeated expressions are not parsed again
+	// Least recently used expressions are dropped once the capacity is reached
+	// Synchronized, can be shared by several threads
+	class ExpressionCache
+	{
+
+	public:
+		ExpressionCache(std::size_t capacity = MathInternals::CacheCapacity)
+			: m_nCapacity(capacity)
+		{
+		}
+
+		ExpressionCache(const ExpressionCache&) = delete;
+
+		ExpressionCache& operator=(const ExpressionCache&) = delete;
+
+		// Compiles the expression if it is not cached yet
+		// Malformed expressions are cached as well
+		CompiledExpression Get(std::string_view expression);
+
+		// A capacity of 0 disables the cache, every expression is compiled then
+		void SetCapacity(std::size_t capacity);
+
+		std::size_t GetCapacity() const;
+
+		std::size_t Size() const;
+
+		// Drops every expression and resets the counters
+		void Clear();
+
+		std::uint64_t GetHits() const;
+
+		std::uint64_t GetMisses() const;
+
+	private:
+		struct Entry
+		{
+			std::string expression;
+			CompiledExpression compiled;
+		};
+
+		void Trim(std::size_t capacity);
+
+		mutable std::mutex m_mutex;
+		// Read without the lock to skip a disabled cache, written with it held
+		std::atomic<std::size_t> m_nCapacity;
+		// Most recently used first
+		std::list<Entry> m_lEntries;
+		// Keys point into the entries, list nodes never move
+		std::unordered_map<std::string_view, std::list<Entry>::iterator> m_mIndex;
+		std::uint64_t m_nHits = 0u;
+		// Misses of a disabled cache are counted without the lock
+		std::atomic<std::uint64_t> m_nMisses{ 0u };
+
+	};
+
+	// Compiled expression translated into native machine code
+	// Only x86-64 outside of Windows is supported, the expression is interpreted on other targets and when it contains an assignment
+	// Copies share the same code, can be evaluated from several threads at once
+	class JitExpression
+	{
+
+	public:
+		JitExpression(const CompiledExpression &expression);
+
+		bool Error() const { return m_expression.Error(); }
+
+		bool IsNative() const { return m_native != nullptr; }
+
+		// Gives the same results as CompiledExpression::Evaluate()
+		Result Evaluate(MathInternals::State *state = nullptr) const;
+
+		// Bindings of the expression, see CompiledExpression
+		MathInternals::NumberType *Bind(std::string_view name) { return m_expression.Bind(name); }
+
+		bool Bind(std::string_view name, const MathInternals::NumberType *memory) { return m_expression.Bind(name, memory); }
+
+		void Unbind(std::string_view name) { m_expression.Unbind(name); }
+
+	private:
+		CompiledExpression m_expression;
+		std::shared_ptr<const MathInternals::NativeCode> m_native;
+
+	};
+
+	// Cache used by Evaluate(), set its capacity to 0 to opt out
+	ExpressionCache &GetExpressionCache();
+
+	// Time spent in each phase and counts of the work done, gathered per thread
+	// Only gathered if the library is built with MATHEVALUATOR_INSTRUMENTATION, all zeros otherwise
+	struct Statistics
+	{
+		/* Phases, in nanoseconds */
+		// Tokenizing and the shunting-yard algorithm, done in a single pass
+		std::uint64_t parseTime = 0u;
+		std::uint64_t optimizeTime = 0u;
+		std::uint64_t cacheTime = 0u;
+		// Interpreter, native code and batches
+		std::uint64_t executeTime = 0u;
+		std::uint64_t formatTime = 0u;
+
+		/* Counters */
+		std::uint64_t compilations = 0u;
+		// Instructions of the compiled programs, after optimization
+		std::uint64_t instructions = 0u;
+		std::uint64_t evaluations = 0u;
+		std::uint64_t executedInstructions = 0u;
+		// Heap allocations made by compilation and evaluation, except the ones of the standard library internals
+		std::uint64_t allocations = 0u;
+		std::uint64_t cacheHits = 0u;
+		std::uint64_t cacheMisses = 0u;
+
+		Statistics operator-(const Statistics &other) const;
+	};
+
+	// Receives the statistics of a single Evaluate() call
+	using StatisticsCallback = void(*)(const Statistics &call);
+
+	bool IsInstrumented();
+
+	// Statistics of the calling thread since the last reset
+	Statistics GetStatistics();
+
+	void ResetStatistics();
+
+	// Called on the evaluating thread after every Evaluate(), nullptr to remove
+	void SetStatisticsCallback(StatisticsCallback callback);
+
+	// Compile() and Evaluate() are reentrant and do not depend on the process locale
+	// Only the state passed in is modified, it must not be used by other threads at the same time
+
+	// Calls of functions defined in the state are inlined, the expression does not depend on the state afterwards
+	CompiledExpression Compile(std::string_view expression, const MathInternals::State *state = nullptr);
+
+	// Compiled through the expression cache, unless the state has functions defined
+	// Definitions of functions, such as f(x, y) = x^2 + y, are stored in the state and evaluate to 0
+	Result Evaluate(std::string_view expression, MathInternals::State *state = nullptr);
+
+	// Values of a variable for every row of EvaluateBatch()
+	struct Column
+	{
+		std::string_view name;
+		const MathInternals::NumberType *values;
+	};
+
+	// Evaluates the expression for every row, writes one result per row to the output
+	// Variables take their values from the column of the same name
+	// Variables without a column are read from their binding or the state and stay the same for every row
+	// Fails on malformed expressions, undefined variables and assignments, the output is unspecified then
+	bool EvaluateBatch(const CompiledExpression &expression, const std::vector<Column> &columns, std::size_t rows, MathInternals::NumberType *output, const MathInternals::State *state = nullptr);
+
+	// Distribution of the rows of EvaluateBatchParallel() over threads
+	struct BatchSchedule
+	{
+		// 0 for every hardware thread, never more than the number of chunks
+		std::size_t threads = 0u;
+		// Rows evaluated by a thread at once, chunks of a few columns should fit in the cache
+		std::size_t chunk = MathInternals::BatchChunkSize;
+	};
+
+	// Same results as EvaluateBatch(), chunks of rows are evaluated by several threads
+	// Every thread starts with an equal share of the chunks and takes over the chunks of others once it is done
+	bool EvaluateBatchParallel(const CompiledExpression &expression, const std::vector<Column> &columns, std::size_t rows, MathInternals::NumberType *output, const BatchSchedule &schedule = BatchSchedule(), const MathInternals::State *state = nullptr);
 
 	class State
 	{
 
 	public:
 		State()
-			: m_state({ })
+			: m_state()
 		{
 		}
 
+		// Overwrites the value if the variable is already defined
 		template<typename T>
-		void AddVariable(std::string name, T value)
+		void AddVariable(std::string_view name, T value)
 		{
-			m_state.push_back({ name, static_cast<MathInternals::NumberType>(value) });
+			SetVariable(name, value);
 		}
 
-		Result Evaluate(std::string expression) { return MathExpressions::Evaluate(expression, &m_state); }
+		template<typename T>
+		void SetVariable(std::string_view name, T value)
+		{
+			m_state.Set(name, static_cast<MathInternals::NumberType>(value));
+		}
+
+		// Results in an error if the variable is not defined
+		Result GetVariable(std::string_view name) const
+		{
+			MathInternals::State::Slot slot = m_state.Find(name);
+			if (slot == MathInternals::State::InvalidSlot)
+				return Result();
+
+			return Result(m_state.GetValue(slot));
+		}
+
+		Result Evaluate(std::string_view expression) { return MathExpressions::Evaluate(expression, &m_state); }
+
+		// Assignments in reactive mode record their formula, see MathInternals::State
+		void SetReactive(bool reactive) { m_state.SetReactive(reactive); }
+
+		bool IsReactive() const { return m_state.IsReactive(); }
+
+		void SetThreads(std::size_t threads) { m_state.SetThreads(threads); }
+
+		// Functions defined so far are inlined
+		CompiledExpression Compile(std::string_view expression) const { return MathExpressions::Compile(expression, &m_state); }
+
+		Result Evaluate(const CompiledExpression &expression) { return expression.Evaluate(&m_state); }
+
+		bool EvaluateBatch(const CompiledExpression &expression, const std::vector<Column> &columns, std::size_t rows, MathInternals::NumberType *output) const
+		{
+			return MathExpressions::EvaluateBatch(expression, columns, rows, output, &m_state);
+		}
+
+		bool EvaluateBatchParallel(const CompiledExpression &expression, const std::vector<Column> &columns, std::size_t rows, MathInternals::NumberType *output, const BatchSchedule &schedule = BatchSchedule()) const
+		{
+			return MathExpressions::EvaluateBatchParallel(expression, columns, rows, output, schedule, &m_state);
+		}
 
 	private:
 		MathInternals::State m_state;
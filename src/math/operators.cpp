@@ -5,36 +5,22 @@
 #include <random>
 #include <functional>
 
-static MathInternals::NumberType PopStack(MathInternals::OperandStack &stack);
+static std::mt19937 &GetGenerator();
 
-MathInternals::Operator MathInternals::g_leftParen("(", 0u, 0u, false, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+MathInternals::Operator MathInternals::g_leftParen("(", 0u, 0u, false, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 {
 	// Return value should be discarded
 	return 0;
 });
 
-MathInternals::Operator MathInternals::g_negation("-", 1u, 5u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+MathInternals::Operator MathInternals::g_negation("-", 1u, 5u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 {
-	return -PopStack(args);
+	return -args[0];
 });
 
-MathInternals::AssignmentOperator MathInternals::g_assignment("=", [](MathInternals::State &state, std::string name, MathInternals::Operand *operand) -> MathInternals::NumberType
+MathInternals::AssignmentOperator MathInternals::g_assignment("=", [](MathInternals::State &state, const std::string &name, MathInternals::NumberType value) -> MathInternals::NumberType
 {
-	MathInternals::NumberType value = operand->GetValue();
-	delete operand;
-
-	bool bFound = false;
-	for (std::pair<std::string, MathInternals::NumberType> &variable : state)
-	{
-		if (variable.first == name)
-		{
-			bFound = true;
-			variable.second = value;
-		}
-	}
-	
-	if (!bFound)
-		state.push_back({ name, value });
+	state.Set(name, value);
 
 	return value;
 });
@@ -51,50 +37,44 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 	// Operator constructor:
 	// name, num of args, precedence (5 for functions), is left associate?, action
 	// Action:
-	// Lambda function, takes in a reference to a stack of arguments, returns an operand
-	// All arguments should be popped
-	// Order of evaluation is not guaranteed, values that come first in an operation have to be stored
+	// Lambda function, takes in a pointer to the arguments in the order they appear in the expression, returns a number
+	// At most MaxOperands arguments, the array must not be modified
 
 	/* Basic operators */
-	MathInternals::Operator("+", 2u, 1u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("+", 2u, 1u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return PopStack(args) + PopStack(args);
+		return args[0] + args[1];
 	}),
-	MathInternals::Operator("-", 2u, 1u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("-", 2u, 1u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
-		return arg - PopStack(args);
+		return args[0] - args[1];
 	}),
-	MathInternals::Operator("*", 2u, 2u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("*", 2u, 2u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return PopStack(args) * PopStack(args);
+		return args[0] * args[1];
 	}),
-	MathInternals::Operator("/", 2u, 2u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("/", 2u, 2u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
-		return arg / PopStack(args);
+		return args[0] / args[1];
 	}),
-	MathInternals::Operator("^", 2u, 3u, false, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("^", 2u, 3u, false, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
-		return static_cast<MathInternals::NumberType>(std::pow(arg, PopStack(args)));
+		return static_cast<MathInternals::NumberType>(std::pow(args[0], args[1]));
 	}),
-	MathInternals::Operator("%", 2u, 2u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("%", 2u, 2u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
-		return static_cast<MathInternals::NumberType>(std::fmod(arg, PopStack(args)));
+		return static_cast<MathInternals::NumberType>(std::fmod(args[0], args[1]));
 	}),
-	MathInternals::Operator("mod", 2u, 2u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("mod", 2u, 2u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
-		return static_cast<MathInternals::NumberType>(std::fmod(arg, PopStack(args)));
+		return static_cast<MathInternals::NumberType>(std::fmod(args[0], args[1]));
 	}),
 
 	/* Bitwise operators */
-	MathInternals::Operator("&", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("&", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -105,10 +85,10 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 			return 0;
 		}
 	}),
-	MathInternals::Operator("and", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("and", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -119,10 +99,10 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 			return 0;
 		}
 	}),
-	MathInternals::Operator("|", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("|", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -133,10 +113,10 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 			return 0;
 		}
 	}),
-	MathInternals::Operator("or", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("or", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -147,10 +127,10 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 			return 0;
 		}
 	}),
-	MathInternals::Operator("xor", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("xor", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -161,10 +141,10 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 			return 0;
 		}
 	}),
-	MathInternals::Operator("<<", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("<<", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -175,10 +155,10 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 			return 0;
 		}
 	}),
-	MathInternals::Operator(">>", 2u, 0u, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator(">>", 2u, 0u, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		if (std::floor(arg1) == arg1 && std::floor(arg2) == arg2)
 		{
@@ -191,133 +171,128 @@ std::vector<MathInternals::Operator> MathInternals::g_vOperators =
 	}),
 
 	/* Power and exponentials */
-	MathInternals::Operator("pow", 2u, MathInternals::FunctionPrecedence, false, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("pow", 2u, MathInternals::FunctionPrecedence, false, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
-		return static_cast<MathInternals::NumberType>(std::pow(arg, PopStack(args)));
+		return static_cast<MathInternals::NumberType>(std::pow(args[0], args[1]));
 	}),
-	MathInternals::Operator("sqrt", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("sqrt", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::sqrt(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::sqrt(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("exp", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("exp", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::exp(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::exp(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("ln", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("ln", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::log(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::log(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("lg", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("lg", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::log10(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::log10(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("log2", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("log2", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::log2(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::log2(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("log", 2u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("log", 2u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg = PopStack(args);
 		return static_cast<MathInternals::NumberType>(
-			std::log(static_cast<double>(PopStack(args))) / std::log(static_cast<double>(arg))
+			std::log(static_cast<double>(args[1])) / std::log(static_cast<double>(args[0]))
 		);
 	}),
 
 	/* Trigonometry */
-	MathInternals::Operator("sin", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("sin", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::sin(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::sin(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("cos", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("cos", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::cos(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::cos(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("tan", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("tan", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::tan(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::tan(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("asin", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("asin", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::asin(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::asin(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("acos", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("acos", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::acos(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::acos(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("atan", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("atan", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::atan(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::atan(static_cast<double>(args[0])));
 	}),
 
 	/* Number functions */
-	MathInternals::Operator("max", 2u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("max", 2u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		return arg1 > arg2 ? arg1 : arg2;
 	}),
-	MathInternals::Operator("min", 2u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("min", 2u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 
 		return arg1 < arg2 ? arg1 : arg2;
 	}),
-	MathInternals::Operator("abs", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("abs", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::abs(PopStack(args)));
+		return static_cast<MathInternals::NumberType>(std::abs(args[0]));
 	}),
-	MathInternals::Operator("round", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("round", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::round(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::round(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("ceil", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("ceil", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::ceil(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::ceil(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("floor", 1u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("floor", 1u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		return static_cast<MathInternals::NumberType>(std::floor(static_cast<double>(PopStack(args))));
+		return static_cast<MathInternals::NumberType>(std::floor(static_cast<double>(args[0])));
 	}),
-	MathInternals::Operator("rand", 2u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	MathInternals::Operator("rand", 2u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		static std::random_device rd;
-		static std::mt19937 rng(rd());
+		std::mt19937 &rng = GetGenerator();
 
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 		if (arg1 > arg2)
 			return 0;
 
 		std::uniform_int_distribution<long long int> dist(static_cast<long long int>(arg1), static_cast<long long int>(arg2));
 
 		return static_cast<MathInternals::NumberType>(dist(rng));
-	}),
-	MathInternals::Operator("randf", 2u, MathInternals::FunctionPrecedence, true, [](MathInternals::OperandStack &args) -> MathInternals::NumberType
+	}, false),
+	MathInternals::Operator("randf", 2u, MathInternals::FunctionPrecedence, true, [](const MathInternals::NumberType *args) -> MathInternals::NumberType
 	{
-		static std::random_device rd;
-		static std::mt19937 rng(rd());
+		std::mt19937 &rng = GetGenerator();
 
-		MathInternals::NumberType arg1 = PopStack(args);
-		MathInternals::NumberType arg2 = PopStack(args);
+		MathInternals::NumberType arg1 = args[0];
+		MathInternals::NumberType arg2 = args[1];
 		if (arg1 > arg2)
 			return 0;
 
 		std::uniform_real_distribution<double> dist(static_cast<double>(arg1), static_cast<double>(arg2));
 
 		return static_cast<MathInternals::NumberType>(dist(rng));
-	})
+	}, false)
 
 };
 
-static MathInternals::NumberType PopStack(MathInternals::OperandStack &stack)
+static std::mt19937 &GetGenerator()
 {
-	MathInternals::NumberType value = stack.top()->GetValue();
-
-	delete stack.top();
-	stack.pop();
+	// Every thread has its own generator, operators can be evaluated concurrently
+	thread_local std::random_device rd;
+	thread_local std::mt19937 rng(rd());
 
-	return value;
+	return rng;
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "internals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "instrumentation.h"
+
+// Value left on the evaluation stack by a part of the program
+struct Subexpression
+{
+	std::size_t start; // Index of the first token
+	bool constant; // Constants are always a single operand
+	MathInternals::NumberType value;
+	bool assignable; // Pushed by a variable, only these can be assigned to
+};
+
+// Index of the operand the operation reduces to, -1 if none
+// Only identities that hold for every value, including NaN and signed zeros
+static int findIdentity(MathInternals::Operator *op, const Subexpression *args)
+{
+	const std::string &name = op->GetName();
+
+	if (name == "*")
+	{
+		if (args[1].constant && args[1].value == 1)
+			return 0;
+		if (args[0].constant && args[0].value == 1)
+			return 1;
+	}
+	else if (name == "/" || name == "^" || name == "pow")
+	{
+		if (args[1].constant && args[1].value == 1)
+			return 0;
+	}
+	else if (name == "-")
+	{
+		// x - 0 is x even for a negative zero
+		if (args[1].constant && args[1].value == 0 && !std::signbit(args[1].value))
+			return 0;
+	}
+	else if (name == "+")
+	{
+		// x + 0 turns a negative zero into a positive one, only adding a negative zero is an identity
+		if (args[1].constant && args[1].value == 0 && std::signbit(args[1].value))
+			return 0;
+		if (args[0].constant && args[0].value == 0 && std::signbit(args[0].value))
+			return 1;
+	}
+
+	return -1;
+}
+
+void MathInternals::Program::Optimize()
+{
+	MATHEVALUATOR_TIMER(optimizeTime);
+
+	ArenaScope arenaScope;
+
+	// An identity that keeps a variable makes the result of the operation assignable
+	// Such identities are skipped if the program assigns, "x*1 = 2" has to stay an error
+	const bool bAssignment = std::any_of(m_vInstructions.begin(), m_vInstructions.end(), [](const Instruction &instruction)
+	{
+		return instruction.code == OpCode::Assign;
+	});
+
+	ArenaVector<Instruction> output;
+	output.reserve(m_vInstructions.size());
+
+	// Numbers that are still used
+	ArenaVector<NumberType> numbers;
+
+	ArenaVector<Subexpression> values;
+
+	for (const Instruction &instruction : m_vInstructions)
+	{
+		if (instruction.code == OpCode::Number)
+		{
+			const NumberType value = m_vNumbers[instruction.index];
+			values.push_back({ output.size(), true, value, false });
+
+			numbers.push_back(value);
+			output.push_back({ OpCode::Number, static_cast<uint32_t>(numbers.size() - 1u) });
+			continue;
+		}
+
+		if (instruction.code == OpCode::Variable)
+		{
+			values.push_back({ output.size(), false, 0, true });
+			output.push_back(instruction);
+			continue;
+		}
+
+		if (instruction.code == OpCode::Copy)
+		{
+			// Arguments that are constant are copied as numbers, the stack keeps the same layout
+			const Subexpression &argument = values[instruction.index];
+			if (argument.constant)
+			{
+				values.push_back({ output.size(), true, argument.value, false });
+
+				numbers.push_back(argument.value);
+				output.push_back({ OpCode::Number, static_cast<uint32_t>(numbers.size() - 1u) });
+			}
+			else
+			{
+				values.push_back({ output.size(), false, 0, false });
+				output.push_back(instruction);
+			}
+			continue;
+		}
+
+		if (instruction.code == OpCode::Squash)
+		{
+			Subexpression *args = &values[values.size() - instruction.index - 1u];
+			const std::size_t start = args[0].start;
+			const Subexpression result = values.back();
+
+			// A call with constant arguments and a constant result is folded into its result
+			if (std::all_of(args, args + instruction.index + 1u, [](const Subexpression &arg) { return arg.constant; }))
+			{
+				numbers.resize(numbers.size() - instruction.index - 1u);
+				output.resize(start);
+
+				values.resize(values.size() - instruction.index - 1u);
+				values.push_back({ start, true, result.value, false });
+
+				numbers.push_back(result.value);
+				output.push_back({ OpCode::Number, static_cast<uint32_t>(numbers.size() - 1u) });
+				continue;
+			}
+
+			values.resize(values.size() - instruction.index - 1u);
+			values.push_back({ start, false, 0, false });
+			output.push_back(instruction);
+			continue;
+		}
+
+		Operator *op = m_vOperators[instruction.index];
+		const uint8_t numArgs = op->GetNumOperands();
+		Subexpression *args = &values[values.size() - numArgs];
+		const std::size_t start = args[0].start;
+
+		if (instruction.code != OpCode::Assign && op->IsPure() && std::all_of(args, args + numArgs, [](const Subexpression &arg) { return arg.constant; }))
+		{
+			NumberType operands[MaxOperands];
+			for (uint8_t i = 0; i < numArgs; i++)
+				operands[i] = args[i].value;
+
+			const NumberType value = op->Evaluate(operands);
+
+			// Replace the operands with the result, the last numbers belong to them
+			numbers.resize(numbers.size() - numArgs);
+			output.resize(start);
+
+			values.resize(values.size() - numArgs);
+			values.push_back({ start, true, value, false });
+
+			numbers.push_back(value);
+			output.push_back({ OpCode::Number, static_cast<uint32_t>(numbers.size() - 1u) });
+			continue;
+		}
+
+		if (numArgs == 2u)
+		{
+			int identity = findIdentity(op, args);
+			if (identity >= 0 && bAssignment && args[identity].assignable)
+				identity = -1;
+
+			if (identity == 0)
+			{
+				// Drop the constant right operand
+				numbers.pop_back();
+				output.pop_back();
+				values.pop_back();
+				continue;
+			}
+			if (identity == 1)
+			{
+				// Drop the constant left operand, the right one moves into its place
+				// Values above the left operand move down the stack, copies of them have to follow
+				// Copies of the left operand itself have been turned into numbers, it is a constant
+				const std::size_t position = values.size() - 2u;
+				numbers.erase(numbers.begin() + output[start].index);
+				output.erase(output.begin() + start);
+				for (std::size_t i = start; i < output.size(); i++)
+				{
+					if (output[i].code == OpCode::Number)
+						output[i].index--;
+					else if (output[i].code == OpCode::Copy && output[i].index > position)
+						output[i].index--;
+				}
+
+				const bool assignable = values.back().assignable;
+				values.pop_back();
+				values.back() = { start, false, 0, assignable };
+				continue;
+			}
+		}
+
+		values.resize(values.size() - numArgs);
+		values.push_back({ start, false, 0, false });
+		output.push_back(instruction);
+	}
+
+	// Recount the depth of the evaluation stack
+	m_vInstructions.clear();
+	m_vNumbers.assign(numbers.begin(), numbers.end());
+	m_nDepth = 0u;
+	m_nStackSize = 0u;
+	m_bUnderflow = false;
+
+	for (const Instruction &instruction : output)
+		Push(instruction);
+}
\ No newline at end of file
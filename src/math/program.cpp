@@ -0,0 +1,147 @@
+#include "internals.h"
+
+#include <string>
+#include <vector>
+
+#include "instrumentation.h"
+
+static MathInternals::OpCode getOpCode(MathInternals::Operator *op);
+
+void MathInternals::Program::PushNumber(MathInternals::NumberType value)
+{
+	if (m_vNumbers.size() == m_vNumbers.capacity())
+		MATHEVALUATOR_COUNT(allocations, 1u);
+
+	m_vNumbers.push_back(value);
+	Push({ OpCode::Number, static_cast<uint32_t>(m_vNumbers.size() - 1u) });
+}
+
+void MathInternals::Program::PushVariable(std::string_view name)
+{
+	uint32_t index = 0;
+	while (index < m_vVariables.size() && m_vVariables[index] != name)
+		index++;
+
+	if (index == m_vVariables.size())
+	{
+		if (m_vVariables.size() == m_vVariables.capacity())
+			MATHEVALUATOR_COUNT(allocations, 1u);
+
+		m_vVariables.emplace_back(name);
+	}
+
+	Push({ OpCode::Variable, index });
+}
+
+void MathInternals::Program::PushOperator(MathInternals::Operator *op)
+{
+	uint32_t index = 0;
+	while (index < m_vOperators.size() && m_vOperators[index] != op)
+		index++;
+
+	if (index == m_vOperators.size())
+	{
+		if (m_vOperators.size() == m_vOperators.capacity())
+			MATHEVALUATOR_COUNT(allocations, 1u);
+
+		m_vOperators.push_back(op);
+	}
+
+	Push({ getOpCode(op), index });
+}
+
+void MathInternals::Program::PushFunction(const MathInternals::State::Function &function)
+{
+	const std::size_t numArgs = function.parameters.size();
+	if (m_nDepth < numArgs)
+	{
+		m_bUnderflow = true;
+		return;
+	}
+
+	// The arguments are already on the stack, the body continues above them
+	const uint32_t arguments = static_cast<uint32_t>(m_nDepth - numArgs);
+	const uint32_t frame = static_cast<uint32_t>(m_nDepth);
+
+	const Program &body = *function.program;
+	for (const Instruction &instruction : body.m_vInstructions)
+	{
+		switch (instruction.code)
+		{
+		case OpCode::Number:
+			PushNumber(body.GetNumber(instruction.index));
+			break;
+
+		case OpCode::Variable:
+		{
+			// Parameters read their argument, other variables stay variables of the caller
+			const std::string &name = body.GetVariable(instruction.index);
+			uint32_t parameter = 0;
+			while (parameter < numArgs && function.parameters[parameter] != name)
+				parameter++;
+
+			if (parameter < numArgs)
+				Push({ OpCode::Copy, arguments + parameter });
+			else
+				PushVariable(name);
+			break;
+		}
+
+		case OpCode::Copy:
+			Push({ OpCode::Copy, frame + instruction.index });
+			break;
+
+		case OpCode::Squash:
+			Push(instruction);
+			break;
+
+		default:
+			PushOperator(body.GetOperator(instruction.index));
+			break;
+		}
+	}
+
+	if (numArgs != 0u)
+		Push({ OpCode::Squash, static_cast<uint32_t>(numArgs) });
+}
+
+void MathInternals::Program::Push(MathInternals::Instruction instruction)
+{
+	if (m_vInstructions.size() == m_vInstructions.capacity())
+		MATHEVALUATOR_COUNT(allocations, 1u);
+
+	m_vInstructions.push_back(instruction);
+
+	// Keep track of the depth of the evaluation stack
+	uint8_t numOperands = GetNumOperands(instruction);
+	if (m_nDepth < numOperands)
+		m_bUnderflow = true;
+	else
+		m_nDepth = m_nDepth - numOperands + 1;
+
+	if (m_nDepth > m_nStackSize)
+		m_nStackSize = m_nDepth;
+}
+
+static MathInternals::OpCode getOpCode(MathInternals::Operator *op)
+{
+	if (op == &MathInternals::g_assignment)
+		return MathInternals::OpCode::Assign;
+	if (op == &MathInternals::g_negation)
+		return MathInternals::OpCode::Negate;
+
+	if (op->GetNumOperands() == 2u)
+	{
+		const std::string &name = op->GetName();
+		if (name == "+")
+			return MathInternals::OpCode::Add;
+		if (name == "-")
+			return MathInternals::OpCode::Subtract;
+		if (name == "*")
+			return MathInternals::OpCode::Multiply;
+		if (name == "/")
+			return MathInternals::OpCode::Divide;
+	}
+
+	return MathInternals::OpCode::Call;
+}
\ No newline at end of file
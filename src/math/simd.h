@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+#include "kernels.h"
+
+// Vectorized kernels shared by every instruction set
+// Included by the translation unit of an instruction set after its traits are defined
+// Traits provide the lane-wise primitives used below, see kernels_sse2.cpp
+// Everything has internal linkage, code compiled for one instruction set must not be shared with another
+
+static_assert(std::is_same<MathInternals::NumberType, double>::value, "Vectorized kernels operate on doubles");
+
+namespace MathInternals
+{
+
+	namespace Simd
+	{
+
+		namespace
+		{
+
+			// Adding and subtracting it rounds a number to an integer, the integer is kept in the low bits
+			constexpr double RoundingShifter = 6755399441055744.0; // 1.5 * 2^52
+
+			// Largest argument of sin() and cos() reduced without the standard library
+			// The multiples of pi/2 are exact up to 2^20
+			constexpr double MaxTrigonometricArgument = 524288.0; // 2^19
+
+			// Smaller reduced arguments of sin() and cos() are left to the standard library
+			// Close to a multiple of pi/2 the reduction cancels, the error of the split of pi/2 becomes significant
+			constexpr double MinReducedArgument = 5.9604644775390625e-08; // 2^-24
+
+			// Applies the standard library function to every lane
+			// Used for lanes outside of the range of the approximations
+			template<typename Isa, double(*Fn)(double)>
+			inline typename Isa::Vector Map(typename Isa::Vector x)
+			{
+				alignas(32) double lanes[Isa::Width];
+				Isa::Store(lanes, x);
+
+				for (std::size_t i = 0; i < Isa::Width; i++)
+					lanes[i] = Fn(lanes[i]);
+
+				return Isa::Load(lanes);
+			}
+
+			// Applies the standard library function to every pair of lanes
+			template<typename Isa, double(*Fn)(double, double)>
+			inline typename Isa::Vector Map(typename Isa::Vector a, typename Isa::Vector b)
+			{
+				alignas(32) double lanesA[Isa::Width];
+				alignas(32) double lanesB[Isa::Width];
+				Isa::Store(lanesA, a);
+				Isa::Store(lanesB, b);
+
+				for (std::size_t i = 0; i < Isa::Width; i++)
+					lanesA[i] = Fn(lanesA[i], lanesB[i]);
+
+				return Isa::Load(lanesA);
+			}
+
+			inline double StandardExp(double x) { return std::exp(x); }
+
+			inline double StandardLn(double x) { return std::log(x); }
+
+			inline double StandardSin(double x) { return std::sin(x); }
+
+			inline double StandardCos(double x) { return std::cos(x); }
+
+			inline double StandardPow(double x, double y) { return std::pow(x, y); }
+
+			template<typename Isa>
+			inline typename Isa::Vector Abs(typename Isa::Vector x)
+			{
+				return Isa::AndNot(Isa::Set(-0.0), x);
+			}
+
+			// Flips the sign of the lanes selected by the mask
+			template<typename Isa>
+			inline typename Isa::Vector Negate(typename Isa::Vector mask, typename Isa::Vector x)
+			{
+				return Isa::Xor(x, Isa::And(mask, Isa::Set(-0.0)));
+			}
+
+			// e^x, at most 1 ulp from the correctly rounded result
+			template<typename Isa>
+			inline typename Isa::Vector Exp(typename Isa::Vector x)
+			{
+				using Vector = typename Isa::Vector;
+
+				// Results outside of the range are not normal numbers
+				if (!Isa::All(Isa::LessEqual(Abs<Isa>(x), Isa::Set(708.0))))
+					return Map<Isa, StandardExp>(x);
+
+				// x = k * ln(2) + r, |r| <= ln(2) / 2
+				Vector k = Isa::MulAdd(x, Isa::Set(1.44269504088896338700e+00), Isa::Set(RoundingShifter));
+				typename Isa::Integer exponent = Isa::AsInteger(k);
+				k = Isa::Sub(k, Isa::Set(RoundingShifter));
+
+				Vector r = Isa::MulAdd(k, Isa::Set(-6.93147180369123816490e-01), x);
+				r = Isa::MulAdd(k, Isa::Set(-1.90821492927058770002e-10), r);
+
+				// Taylor series of e^r up to the 13th power
+				Vector p = Isa::Set(1.0 / 6227020800.0);
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 479001600.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 39916800.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 3628800.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 362880.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 40320.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 5040.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 720.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 120.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 24.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0 / 6.0));
+				p = Isa::MulAdd(p, r, Isa::Set(0.5));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0));
+				p = Isa::MulAdd(p, r, Isa::Set(1.0));
+
+				// 2^k is built from its exponent bits, k is within the range of normal numbers
+				exponent = Isa::template ShiftLeft<52>(Isa::AddInteger(exponent, Isa::SetInteger(1023)));
+
+				return Isa::Mul(p, Isa::AsVector(exponent));
+			}
+
+			// Natural logarithm, at most 1 ulp from the correctly rounded result
+			template<typename Isa>
+			inline typename Isa::Vector Ln(typename Isa::Vector x)
+			{
+				using Vector = typename Isa::Vector;
+
+				// Zero, negative, subnormal, infinite and NaN lanes
+				if (!Isa::All(Isa::And(Isa::GreaterEqual(x, Isa::Set(DBL_MIN)), Isa::LessEqual(x, Isa::Set(DBL_MAX)))))
+					return Map<Isa, StandardLn>(x);
+
+				// x = 2^k * m, sqrt(2) / 2 < m < sqrt(2)
+				Vector k = Isa::AsVector(Isa::template ShiftRight<52>(Isa::AsInteger(x)));
+				k = Isa::Sub(Isa::Or(k, Isa::Set(4503599627370496.0)), Isa::Set(4503599627370496.0 + 1023.0));
+
+				Vector m = Isa::Or(Isa::AndNot(Isa::Set(INFINITY), x), Isa::Set(1.0));
+
+				Vector large = Isa::Less(Isa::Set(1.41421356237309504880), m);
+				m = Isa::Select(large, Isa::Mul(m, Isa::Set(0.5)), m);
+				k = Isa::Select(large, Isa::Add(k, Isa::Set(1.0)), k);
+
+				// Same reduction as fdlibm
+				Vector f = Isa::Sub(m, Isa::Set(1.0));
+				Vector hfsq = Isa::Mul(Isa::Mul(Isa::Set(0.5), f), f);
+				Vector s = Isa::Div(f, Isa::Add(Isa::Set(2.0), f));
+				Vector z = Isa::Mul(s, s);
+				Vector w = Isa::Mul(z, z);
+
+				Vector t1 = Isa::MulAdd(w, Isa::Set(1.531383769920937332e-01), Isa::Set(2.222219843214978396e-01));
+				t1 = Isa::MulAdd(w, t1, Isa::Set(3.999999999940941908e-01));
+				t1 = Isa::Mul(w, t1);
+
+				Vector t2 = Isa::MulAdd(w, Isa::Set(1.479819860511658591e-01), Isa::Set(1.818357216161805012e-01));
+				t2 = Isa::MulAdd(w, t2, Isa::Set(2.857142874366239149e-01));
+				t2 = Isa::MulAdd(w, t2, Isa::Set(6.666666666666735130e-01));
+				t2 = Isa::Mul(z, t2);
+
+				Vector R = Isa::Add(t2, t1);
+
+				// k * ln2_hi - ((hfsq - (s * (hfsq + R) + k * ln2_lo)) - f)
+				Vector tail = Isa::MulAdd(s, Isa::Add(hfsq, R), Isa::Mul(k, Isa::Set(1.90821492927058770002e-10)));
+				return Isa::MulAdd(k, Isa::Set(6.93147180369123816490e-01), Isa::Sub(f, Isa::Sub(hfsq, tail)));
+			}
+
+			// sin(r) for |r| <= pi / 4, fdlibm polynomial
+			template<typename Isa>
+			inline typename Isa::Vector KernelSin(typename Isa::Vector r)
+			{
+				using Vector = typename Isa::Vector;
+
+				Vector z = Isa::Mul(r, r);
+				Vector v = Isa::Mul(z, r);
+
+				Vector p = Isa::MulAdd(z, Isa::Set(1.58969099521155010221e-10), Isa::Set(-2.50507602534068634195e-08));
+				p = Isa::MulAdd(z, p, Isa::Set(2.75573137070700676789e-06));
+				p = Isa::MulAdd(z, p, Isa::Set(-1.98412698298579493134e-04));
+				p = Isa::MulAdd(z, p, Isa::Set(8.33333333332248946124e-03));
+				p = Isa::MulAdd(z, p, Isa::Set(-1.66666666666666324348e-01));
+
+				return Isa::MulAdd(v, p, r);
+			}
+
+			// cos(r) for |r| <= pi / 4, fdlibm polynomial
+			template<typename Isa>
+			inline typename Isa::Vector KernelCos(typename Isa::Vector r)
+			{
+				using Vector = typename Isa::Vector;
+
+				Vector z = Isa::Mul(r, r);
+
+				Vector p = Isa::MulAdd(z, Isa::Set(-1.13596475577881948265e-11), Isa::Set(2.08757232129817482790e-09));
+				p = Isa::MulAdd(z, p, Isa::Set(-2.75573143513906633035e-07));
+				p = Isa::MulAdd(z, p, Isa::Set(2.48015872894767294178e-05));
+				p = Isa::MulAdd(z, p, Isa::Set(-1.38888888888741095749e-03));
+				p = Isa::MulAdd(z, p, Isa::Set(4.16666666666666019037e-02));
+				p = Isa::Mul(Isa::Mul(z, z), p);
+
+				// 1 - z / 2 + p, rounding error of the subtraction is added back
+				Vector hz = Isa::Mul(Isa::Set(0.5), z);
+				Vector w = Isa::Sub(Isa::Set(1.0), hz);
+
+				return Isa::Add(w, Isa::Add(Isa::Sub(Isa::Sub(Isa::Set(1.0), w), hz), p));
+			}
+
+			// Reduces x to r = x - k * pi / 2, |r| <= pi / 4, returns k in the low bits of the quadrant
+			template<typename Isa>
+			inline typename Isa::Vector Reduce(typename Isa::Vector x, typename Isa::Integer &quadrant)
+			{
+				using Vector = typename Isa::Vector;
+
+				Vector k = Isa::MulAdd(x, Isa::Set(6.36619772367581382433e-01), Isa::Set(RoundingShifter));
+				quadrant = Isa::AsInteger(k);
+				k = Isa::Sub(k, Isa::Set(RoundingShifter));
+
+				// pi / 2 split into parts of 33 bits, products with k are exact
+				Vector r = Isa::MulAdd(k, Isa::Set(-1.57079632673412561417e+00), x);
+				r = Isa::MulAdd(k, Isa::Set(-6.07710050630396597660e-11), r);
+				return Isa::MulAdd(k, Isa::Set(-2.02226624871116645580e-21), r);
+			}
+
+			// Whether every lane was reduced accurately, arguments below pi / 4 are not reduced at all
+			template<typename Isa>
+			inline bool IsReduced(typename Isa::Vector x, typename Isa::Vector r)
+			{
+				return Isa::All(Isa::Or(Isa::GreaterEqual(Abs<Isa>(r), Isa::Set(MinReducedArgument)), Isa::Less(Abs<Isa>(x), Isa::Set(MinReducedArgument))));
+			}
+
+			// Measured within 2 ulp of the correctly rounded result for |x| <= MaxTrigonometricArgument
+			template<typename Isa>
+			inline typename Isa::Vector Sin(typename Isa::Vector x)
+			{
+				using Vector = typename Isa::Vector;
+
+				if (!Isa::All(Isa::LessEqual(Abs<Isa>(x), Isa::Set(MaxTrigonometricArgument))))
+					return Map<Isa, StandardSin>(x);
+
+				typename Isa::Integer quadrant;
+				Vector r = Reduce<Isa>(x, quadrant);
+				if (!IsReduced<Isa>(x, r))
+					return Map<Isa, StandardSin>(x);
+
+				Vector res = Isa::Select(Isa::TestBits(quadrant, 1), KernelCos<Isa>(r), KernelSin<Isa>(r));
+				return Negate<Isa>(Isa::TestBits(quadrant, 2), res);
+			}
+
+			// Measured within 2 ulp of the correctly rounded result for |x| <= MaxTrigonometricArgument
+			template<typename Isa>
+			inline typename Isa::Vector Cos(typename Isa::Vector x)
+			{
+				using Vector = typename Isa::Vector;
+
+				if (!Isa::All(Isa::LessEqual(Abs<Isa>(x), Isa::Set(MaxTrigonometricArgument))))
+					return Map<Isa, StandardCos>(x);
+
+				typename Isa::Integer quadrant;
+				Vector r = Reduce<Isa>(x, quadrant);
+				if (!IsReduced<Isa>(x, r))
+					return Map<Isa, StandardCos>(x);
+
+				Vector res = Isa::Select(Isa::TestBits(quadrant, 1), KernelSin<Isa>(r), KernelCos<Isa>(r));
+
+				// Quadrants 1 and 2 are negative
+				quadrant = Isa::AddInteger(quadrant, Isa::SetInteger(1));
+				return Negate<Isa>(Isa::TestBits(quadrant, 2), res);
+			}
+
+			template<typename Isa>
+			inline typename Isa::Vector Sqrt(typename Isa::Vector x) { return Isa::Sqrt(x); }
+
+			// Squares are multiplied, the product is rounded once the same as the result of std::pow()
+			// Other exponents are left to the standard library
+			template<typename Isa>
+			inline typename Isa::Vector Pow(typename Isa::Vector x, typename Isa::Vector y)
+			{
+				if (Isa::All(Isa::Equal(y, Isa::Set(2.0))))
+					return Isa::Mul(x, x);
+
+				return Map<Isa, StandardPow>(x, y);
+			}
+
+			template<typename Isa>
+			inline typename Isa::Vector Neg(typename Isa::Vector x) { return Isa::Xor(x, Isa::Set(-0.0)); }
+
+			template<typename Isa>
+			inline typename Isa::Vector Add(typename Isa::Vector a, typename Isa::Vector b) { return Isa::Add(a, b); }
+
+			template<typename Isa>
+			inline typename Isa::Vector Sub(typename Isa::Vector a, typename Isa::Vector b) { return Isa::Sub(a, b); }
+
+			template<typename Isa>
+			inline typename Isa::Vector Mul(typename Isa::Vector a, typename Isa::Vector b) { return Isa::Mul(a, b); }
+
+			template<typename Isa>
+			inline typename Isa::Vector Div(typename Isa::Vector a, typename Isa::Vector b) { return Isa::Div(a, b); }
+
+			// Same as the operator, the second operand is returned if either is NaN
+			template<typename Isa>
+			inline typename Isa::Vector Max(typename Isa::Vector a, typename Isa::Vector b) { return Isa::Max(a, b); }
+
+			template<typename Isa>
+			inline typename Isa::Vector Min(typename Isa::Vector a, typename Isa::Vector b) { return Isa::Min(a, b); }
+
+			// Applies a lane-wise function to a block of rows
+			template<typename Isa, typename Isa::Vector(*Fn)(typename Isa::Vector)>
+			void UnaryKernel(const NumberType *const *args, NumberType *result, std::size_t count)
+			{
+				const double *x = args[0];
+
+				std::size_t i = 0;
+				for (; i + Isa::Width <= count; i += Isa::Width)
+					Isa::Store(result + i, Fn(Isa::Load(x + i)));
+
+				// The last lanes are padded with a copy of the last row
+				if (i < count)
+				{
+					alignas(32) double lanes[Isa::Width];
+					for (std::size_t lane = 0; lane < Isa::Width; lane++)
+						lanes[lane] = x[i + lane < count ? i + lane : count - 1];
+
+					Isa::Store(lanes, Fn(Isa::Load(lanes)));
+
+					for (std::size_t lane = 0; i + lane < count; lane++)
+						result[i + lane] = lanes[lane];
+				}
+			}
+
+			template<typename Isa, typename Isa::Vector(*Fn)(typename Isa::Vector, typename Isa::Vector)>
+			void BinaryKernel(const NumberType *const *args, NumberType *result, std::size_t count)
+			{
+				const double *a = args[0];
+				const double *b = args[1];
+
+				std::size_t i = 0;
+				for (; i + Isa::Width <= count; i += Isa::Width)
+					Isa::Store(result + i, Fn(Isa::Load(a + i), Isa::Load(b + i)));
+
+				if (i < count)
+				{
+					alignas(32) double lanesA[Isa::Width];
+					alignas(32) double lanesB[Isa::Width];
+					for (std::size_t lane = 0; lane < Isa::Width; lane++)
+					{
+						std::size_t row = i + lane < count ? i + lane : count - 1;
+						lanesA[lane] = a[row];
+						lanesB[lane] = b[row];
+					}
+
+					Isa::Store(lanesA, Fn(Isa::Load(lanesA), Isa::Load(lanesB)));
+
+					for (std::size_t lane = 0; i + lane < count; lane++)
+						result[i + lane] = lanesA[lane];
+				}
+			}
+
+		}
+
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,407 @@
+#include "mathevaluator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "internals.h"
+#include "threadpool.h"
+
+// Number of buckets allocated for the first variable
+constexpr std::size_t InitialBuckets = 16u;
+
+// Smallest number of formulas recomputed by several threads, fewer are not worth waking the threads
+constexpr std::size_t ParallelFormulas = 512u;
+
+// Formulas ready to be computed by a worker
+// The owner takes the most recent formula, other workers steal the oldest one
+struct WorkQueue
+{
+	std::mutex mutex;
+	std::vector<MathInternals::State::Slot> slots;
+	std::size_t head = 0u;
+};
+
+MathInternals::State::Slot MathInternals::State::Find(std::string_view name) const
+{
+	if (m_vBuckets.empty())
+		return InvalidSlot;
+
+	const std::size_t hash = std::hash<std::string_view>()(name);
+	const std::size_t mask = m_vBuckets.size() - 1;
+
+	// Linear probing, the table always has empty buckets
+	for (std::size_t bucket = hash & mask; ; bucket = (bucket + 1) & mask)
+	{
+		Slot slot = m_vBuckets[bucket];
+		if (slot == InvalidSlot)
+			return InvalidSlot;
+
+		if (m_vHashes[slot] == hash && m_vNames[slot] == name)
+			return slot;
+	}
+}
+
+MathInternals::State::Slot MathInternals::State::Set(std::string_view name, NumberType value)
+{
+	Slot slot = Find(name);
+	if (slot == InvalidSlot)
+		slot = Add(name, value);
+	else
+		m_vValues[slot] = value;
+
+	if (m_bReactive)
+		Update(slot);
+
+	return slot;
+}
+
+MathInternals::State::Slot MathInternals::State::Add(std::string_view name, NumberType value)
+{
+	Slot slot = static_cast<Slot>(m_vNames.size());
+	m_vNames.emplace_back(name);
+	m_vHashes.push_back(std::hash<std::string_view>()(name));
+	m_vValues.push_back(value);
+
+	// Keep the load factor at or below one half
+	if (m_vNames.size() * 2 > m_vBuckets.size())
+		Rehash(m_vBuckets.empty() ? InitialBuckets : m_vBuckets.size() * 2);
+	else
+		Insert(slot);
+
+	return slot;
+}
+
+void MathInternals::State::Insert(Slot slot)
+{
+	const std::size_t mask = m_vBuckets.size() - 1;
+
+	std::size_t bucket = m_vHashes[slot] & mask;
+	while (m_vBuckets[bucket] != InvalidSlot)
+		bucket = (bucket + 1) & mask;
+
+	m_vBuckets[bucket] = slot;
+}
+
+void MathInternals::State::Rehash(std::size_t buckets)
+{
+	m_vBuckets.assign(buckets, InvalidSlot);
+
+	for (std::size_t slot = 0; slot < m_vNames.size(); slot++)
+		Insert(static_cast<Slot>(slot));
+}
+
+const MathInternals::State::Function *MathInternals::State::FindFunction(std::string_view name) const
+{
+	// Few functions are defined, a linear search is enough
+	for (const std::pair<std::string, Function> &function : m_vFunctions)
+	{
+		if (function.first == name)
+			return &function.second;
+	}
+
+	return nullptr;
+}
+
+void MathInternals::State::SetFunction(std::string_view name, Function function)
+{
+	for (std::pair<std::string, Function> &entry : m_vFunctions)
+	{
+		if (entry.first == name)
+		{
+			entry.second = std::move(function);
+			return;
+		}
+	}
+
+	m_vFunctions.emplace_back(name, std::move(function));
+}
+
+void MathInternals::State::SetReactive(bool reactive)
+{
+	m_bReactive = reactive;
+	if (reactive)
+		return;
+
+	m_vFormulas.clear();
+	m_vDependents.clear();
+	m_vMarks.clear();
+}
+
+bool MathInternals::State::SetFormula(std::string_view name, std::shared_ptr<const Program> program, NumberType value)
+{
+	if (!m_bReactive)
+	{
+		Set(name, value);
+		return true;
+	}
+
+	// Formulas are evaluated while the graph is traversed, they cannot change other variables
+	const std::vector<Instruction> &instructions = program->GetInstructions();
+	if (std::any_of(instructions.begin(), instructions.end(), [](const Instruction &instruction) { return instruction.code == OpCode::Assign; }))
+		return false;
+
+	// Inputs of the formula are the variables it reads
+	std::vector<Slot> inputs;
+	for (const std::string &variable : program->GetVariables())
+	{
+		Slot input = Find(variable);
+		if (input == InvalidSlot)
+			return false;
+
+		inputs.push_back(input);
+	}
+
+	// Constants are stored as plain values
+	if (inputs.empty())
+	{
+		Set(name, value);
+		return true;
+	}
+
+	Slot slot = Find(name);
+	if (slot != InvalidSlot)
+	{
+		// The formula cannot depend on its own variable
+		Reserve();
+		SortDependents(slot);
+		for (Slot input : inputs)
+		{
+			if (input == slot || std::find(m_vOrder.begin(), m_vOrder.end(), input) != m_vOrder.end())
+				return false;
+		}
+	}
+	else
+	{
+		slot = Add(name, value);
+	}
+
+	Reserve();
+	RemoveFormula(slot);
+
+	for (Slot input : inputs)
+		m_vDependents[input].push_back(slot);
+
+	m_vFormulas[slot] = { std::move(program), std::move(inputs) };
+	m_vValues[slot] = value;
+
+	Recompute(slot);
+	return true;
+}
+
+const MathInternals::State::Formula *MathInternals::State::GetFormula(Slot slot) const
+{
+	if (slot >= m_vFormulas.size() || m_vFormulas[slot].program == nullptr)
+		return nullptr;
+
+	return &m_vFormulas[slot];
+}
+
+void MathInternals::State::Update(Slot slot)
+{
+	// Nothing to recompute until the first formula is recorded
+	if (m_vFormulas.empty())
+		return;
+
+	Reserve();
+	RemoveFormula(slot);
+	Recompute(slot);
+}
+
+void MathInternals::State::Recompute(Slot slot)
+{
+	SortDependents(slot);
+
+	const std::size_t threads = m_nThreads == 0u ? ThreadPool::GetHardwareThreads() : m_nThreads;
+	if (threads > 1u && m_vOrder.size() >= ParallelFormulas)
+	{
+		RecomputeParallel(threads);
+		return;
+	}
+
+	// Inputs always exist, formulas only fail on malformed programs, which are never recorded
+	for (Slot dependent : m_vOrder)
+	{
+		MathExpressions::Result res = MathExpressions::CompiledExpression(m_vFormulas[dependent].program).Evaluate(this);
+		if (!res.Error())
+			m_vValues[dependent] = res.Get();
+	}
+}
+
+void MathInternals::State::RecomputeParallel(std::size_t threads)
+{
+	const std::size_t count = m_vOrder.size();
+	for (std::size_t rank = 0; rank < count; rank++)
+		m_vRanks[m_vOrder[rank]] = static_cast<Slot>(rank);
+
+	// Inputs that are recomputed as well, a formula is ready once they are all done
+	std::unique_ptr<std::atomic<std::size_t>[]> pending(new std::atomic<std::size_t>[count]);
+	std::unique_ptr<WorkQueue[]> queues(new WorkQueue[std::min(threads, ThreadPool::MaxThreads)]);
+	for (std::size_t rank = 0; rank < count; rank++)
+	{
+		const std::vector<Slot> &inputs = m_vFormulas[m_vOrder[rank]].inputs;
+		std::size_t recomputed = std::count_if(inputs.begin(), inputs.end(), [this](Slot input) { return m_vRanks[input] != InvalidSlot; });
+		pending[rank].store(recomputed, std::memory_order_relaxed);
+
+		if (recomputed == 0u)
+			queues[0].slots.push_back(m_vOrder[rank]);
+	}
+
+	std::atomic<std::size_t> remaining(count);
+
+	// Workers without anything to take sleep until a formula is queued or all of them are done
+	// Sequentially consistent, a worker going to sleep either sees the queued formula or is woken up
+	std::atomic<std::size_t> queued(queues[0].slots.size());
+	std::atomic<std::size_t> sleeping(0u);
+	std::mutex idleMutex;
+	std::condition_variable idle;
+
+	auto wake = [&](bool all)
+	{
+		if (sleeping.load() == 0u)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+		}
+
+		if (all)
+			idle.notify_all();
+		else
+			idle.notify_one();
+	};
+
+	ThreadPool::Get().Run(threads, [&](std::size_t worker, std::size_t workers)
+	{
+		WorkQueue &own = queues[worker];
+
+		auto take = [&](Slot &slot)
+		{
+			{
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (own.slots.size() > own.head)
+				{
+					slot = own.slots.back();
+					own.slots.pop_back();
+					queued.fetch_sub(1u);
+					return true;
+				}
+			}
+
+			for (std::size_t i = 1; i < workers; i++)
+			{
+				WorkQueue &other = queues[(worker + i) % workers];
+				std::lock_guard<std::mutex> lock(other.mutex);
+				if (other.slots.size() > other.head)
+				{
+					slot = other.slots[other.head++];
+					queued.fetch_sub(1u);
+					return true;
+				}
+			}
+
+			return false;
+		};
+
+		while (remaining.load(std::memory_order_acquire) != 0u)
+		{
+			Slot slot;
+			if (!take(slot))
+			{
+				std::unique_lock<std::mutex> lock(idleMutex);
+				sleeping.fetch_add(1u);
+				idle.wait(lock, [&]() { return queued.load() != 0u || remaining.load() == 0u; });
+				sleeping.fetch_sub(1u);
+				continue;
+			}
+
+			// Every formula writes only its own value, inputs are complete before it is taken
+			MathExpressions::Result res = MathExpressions::CompiledExpression(m_vFormulas[slot].program).Evaluate(this);
+			if (!res.Error())
+				m_vValues[slot] = res.Get();
+
+			for (Slot dependent : m_vDependents[slot])
+			{
+				if (pending[m_vRanks[dependent]].fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+				{
+					{
+						std::lock_guard<std::mutex> lock(own.mutex);
+						own.slots.push_back(dependent);
+					}
+
+					queued.fetch_add(1u);
+					wake(false);
+				}
+			}
+
+			// The last formula releases the workers still waiting
+			if (remaining.fetch_sub(1u) == 1u)
+				wake(true);
+		}
+	});
+
+	for (Slot dependent : m_vOrder)
+		m_vRanks[dependent] = InvalidSlot;
+}
+
+void MathInternals::State::RemoveFormula(Slot slot)
+{
+	Formula &formula = m_vFormulas[slot];
+	for (Slot input : formula.inputs)
+	{
+		std::vector<Slot> &dependents = m_vDependents[input];
+		dependents.erase(std::find(dependents.begin(), dependents.end(), slot));
+	}
+
+	formula = Formula();
+}
+
+void MathInternals::State::Reserve()
+{
+	if (m_vFormulas.size() == m_vNames.size())
+		return;
+
+	m_vFormulas.resize(m_vNames.size());
+	m_vDependents.resize(m_vNames.size());
+	m_vMarks.resize(m_vNames.size(), false);
+	m_vRanks.resize(m_vNames.size(), InvalidSlot);
+}
+
+void MathInternals::State::SortDependents(Slot slot)
+{
+	// Depth-first search, the reverse of the postorder is a topological order
+	m_vOrder.clear();
+	m_vPath.assign(1u, { slot, 0u });
+	m_vMarks[slot] = true;
+
+	while (!m_vPath.empty())
+	{
+		const Slot current = m_vPath.back().first;
+		const std::vector<Slot> &dependents = m_vDependents[current];
+		if (m_vPath.back().second < dependents.size())
+		{
+			const Slot dependent = dependents[m_vPath.back().second++];
+			if (!m_vMarks[dependent])
+			{
+				m_vMarks[dependent] = true;
+				m_vPath.push_back({ dependent, 0u });
+			}
+			continue;
+		}
+
+		if (current != slot)
+			m_vOrder.push_back(current);
+		m_vPath.pop_back();
+	}
+
+	// Only the visited variables were marked
+	m_vMarks[slot] = false;
+	for (Slot dependent : m_vOrder)
+		m_vMarks[dependent] = false;
+
+	std::reverse(m_vOrder.begin(), m_vOrder.end());
+}
\ No newline at end of file
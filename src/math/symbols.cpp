@@ -0,0 +1,71 @@
+#include "internals.h"
+
+#include <string>
+#include <vector>
+
+const MathInternals::SymbolTrie &MathInternals::SymbolTrie::Get()
+{
+	static const MathInternals::SymbolTrie trie;
+	return trie;
+}
+
+MathInternals::SymbolTrie::SymbolTrie()
+	: m_aAlphabet(), m_nAlphabetSize(1u)
+{
+	// Column 0 is reserved for characters that are not used in any name
+	auto addCharacters = [this](const std::string &name)
+	{
+		for (unsigned char token : name)
+		{
+			if (m_aAlphabet[token] == 0u)
+				m_aAlphabet[token] = static_cast<uint8_t>(m_nAlphabetSize++);
+		}
+	};
+
+	for (MathInternals::Operator &op : MathInternals::g_vOperators)
+		addCharacters(op.GetName());
+
+	for (std::pair<std::string, MathInternals::NumberType> &item : MathInternals::g_vConstants)
+		addCharacters(item.first);
+
+	// Root node
+	m_vTransitions.assign(m_nAlphabetSize, NoMatch);
+	m_vOperators.push_back(nullptr);
+	m_vConstants.push_back(nullptr);
+
+	// The first definition of a name takes priority, operators come before constants
+	for (MathInternals::Operator &op : MathInternals::g_vOperators)
+	{
+		Node node = AddName(op.GetName());
+		if (m_vOperators[node] == nullptr)
+			m_vOperators[node] = &op;
+	}
+
+	for (std::pair<std::string, MathInternals::NumberType> &item : MathInternals::g_vConstants)
+	{
+		Node node = AddName(item.first);
+		if (m_vOperators[node] == nullptr && m_vConstants[node] == nullptr)
+			m_vConstants[node] = &item.second;
+	}
+}
+
+MathInternals::SymbolTrie::Node MathInternals::SymbolTrie::AddName(const std::string &name)
+{
+	Node node = Root;
+	for (unsigned char token : name)
+	{
+		std::size_t transition = node * m_nAlphabetSize + m_aAlphabet[token];
+		if (m_vTransitions[transition] == NoMatch)
+		{
+			m_vTransitions[transition] = static_cast<Node>(m_vOperators.size());
+
+			m_vTransitions.resize(m_vTransitions.size() + m_nAlphabetSize, NoMatch);
+			m_vOperators.push_back(nullptr);
+			m_vConstants.push_back(nullptr);
+		}
+
+		node = m_vTransitions[transition];
+	}
+
+	return node;
+}
\ No newline at end of file
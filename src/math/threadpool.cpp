@@ -0,0 +1,85 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+MathInternals::ThreadPool &MathInternals::ThreadPool::Get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+std::size_t MathInternals::ThreadPool::GetHardwareThreads()
+{
+	return std::max<std::size_t>(std::thread::hardware_concurrency(), 1u);
+}
+
+MathInternals::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_start.notify_all();
+
+	for (std::thread &thread : m_vThreads)
+		thread.join();
+}
+
+void MathInternals::ThreadPool::Run(std::size_t threads, const Job &job)
+{
+	threads = std::min(threads, MaxThreads);
+	if (threads <= 1u || !m_runMutex.try_lock())
+	{
+		job(0u, 1u);
+		return;
+	}
+
+	std::lock_guard<std::mutex> runLock(m_runMutex, std::adopt_lock);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// The calling thread is the first worker
+		while (m_vThreads.size() < threads - 1u)
+			m_vThreads.emplace_back(&ThreadPool::Work, this, m_vThreads.size() + 1u, m_nGeneration);
+
+		m_pJob = &job;
+		m_nWorkers = threads;
+		m_nRunning = threads - 1u;
+		m_nGeneration++;
+	}
+	m_start.notify_all();
+
+	job(0u, threads);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_nRunning == 0u; });
+	m_pJob = nullptr;
+}
+
+void MathInternals::ThreadPool::Work(std::size_t worker, std::size_t generation)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_start.wait(lock, [&]() { return m_bStop || m_nGeneration != generation; });
+		if (m_bStop)
+			return;
+
+		generation = m_nGeneration;
+
+		// Threads beyond the number of workers sit this job out
+		if (worker >= m_nWorkers)
+			continue;
+
+		const Job &job = *m_pJob;
+		const std::size_t workers = m_nWorkers;
+
+		lock.unlock();
+		job(worker, workers);
+		lock.lock();
+
+		if (--m_nRunning == 0u)
+			m_done.notify_one();
+	}
+}
\ No newline at end of file
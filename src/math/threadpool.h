@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MathInternals
+{
+
+	// Threads shared by the parallel algorithms of the library
+	// Threads are started when a job first needs them and kept until the process exits
+	class ThreadPool
+	{
+
+	public:
+		// Largest number of threads working on a single job
+		static constexpr std::size_t MaxThreads = 256u;
+
+		// Called on every worker with the index of the worker and the number of workers
+		using Job = std::function<void(std::size_t worker, std::size_t workers)>;
+
+		static ThreadPool &Get();
+
+		// Number of threads the hardware runs at once, at least one
+		static std::size_t GetHardwareThreads();
+
+		ThreadPool(const ThreadPool&) = delete;
+
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool();
+
+		// Runs the job on the calling thread and threads - 1 threads of the pool, returns once every worker is done
+		// The job has to finish all of its work with any number of workers
+		// Jobs started while another one is running, such as nested jobs, only get the calling thread
+		void Run(std::size_t threads, const Job &job);
+
+	private:
+		ThreadPool()
+		{
+		}
+
+		void Work(std::size_t worker, std::size_t generation);
+
+		// Held by the running job
+		std::mutex m_runMutex;
+
+		std::mutex m_mutex;
+		std::condition_variable m_start;
+		std::condition_variable m_done;
+		std::vector<std::thread> m_vThreads;
+		const Job *m_pJob = nullptr;
+		std::size_t m_nWorkers = 0u;
+		std::size_t m_nRunning = 0u;
+		// Incremented for every job, workers wait for it to change
+		std::size_t m_nGeneration = 0u;
+		bool m_bStop = false;
+
+	};
+
+}
\ No newline at end of file
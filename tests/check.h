@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Checks of the tests, a failed check is reported and the test goes on
+// main() returns TestResult(), which is nonzero if any check failed
+
+static int g_nFailures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			g_nFailures++; \
+		} \
+	} while (false)
+
+// Numbers are compared exactly, NaN equals NaN
+#define CHECK_NUMBER(actual, expected) \
+	do \
+	{ \
+		const double checkActual = (actual); \
+		const double checkExpected = (expected); \
+		if (!(checkActual == checkExpected || (std::isnan(checkActual) && std::isnan(checkExpected)))) \
+		{ \
+			std::fprintf(stderr, "%s:%d: check failed: %s is %.17g, expected %.17g\n", __FILE__, __LINE__, #actual, checkActual, checkExpected); \
+			g_nFailures++; \
+		} \
+	} while (false)
+
+static int TestResult()
+{
+	if (g_nFailures != 0)
+		std::fprintf(stderr, "%d checks failed\n", g_nFailures);
+
+	return g_nFailures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+/* exports.c : The exported interface used from C, the header has to compile as C */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "exports.h"
+
+static int g_nFailures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			g_nFailures++; \
+		} \
+	} while (0)
+
+int main(void)
+{
+	char result[64];
+	int error = MATHEVALUATOR_ERROR;
+	MathEvaluatorExpression *handle;
+
+	CHECK(evaluate("1 + 2 * 3", result, sizeof(result)) == 1);
+	CHECK(strcmp(result, "7") == 0);
+
+	CHECK(evaluate_value("2 ^ 10garbage", 6, &error) == 1024);
+	CHECK(error == MATHEVALUATOR_OK);
+
+	evaluate_value_state("x = 4", 5, 7, &error);
+	CHECK(error == MATHEVALUATOR_OK);
+
+	handle = compile_expression("x * 2", 5);
+	CHECK(handle != NULL);
+	CHECK(evaluate_expression_state(handle, 7, &error) == 8);
+	CHECK(error == MATHEVALUATOR_OK);
+	release_expression(handle);
+
+	release_state(7);
+	evaluate_value_state("x", 1, 7, &error);
+	CHECK(error == MATHEVALUATOR_ERROR);
+	release_state(7);
+
+	CHECK(compile_expression("(1 +", 4) == NULL);
+
+	if (g_nFailures != 0)
+		fprintf(stderr, "%d checks failed\n", g_nFailures);
+
+	return g_nFailures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+// functions.cpp : User-defined functions, inlined calls and their optimization
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "math/mathevaluator.h"
+
+// Result of the expression, NaN on errors
+static double Evaluate(MathExpressions::State &state, const char *expression)
+{
+	MathExpressions::Result res = state.Evaluate(expression);
+	return res.Error() ? NAN : res.Get();
+}
+
+static void TestDefinitions()
+{
+	MathExpressions::State state;
+	CHECK_NUMBER(Evaluate(state, "f(x, y) = x^2 + y"), 0);
+	CHECK_NUMBER(Evaluate(state, "g(t) = f(t, t) * 2"), 0);
+	CHECK_NUMBER(Evaluate(state, "h() = 7"), 0);
+	CHECK_NUMBER(Evaluate(state, "k(x) = x + a"), 0);
+
+	// Names of operators and constants, repeated parameters
+	CHECK(state.Evaluate("sin(x) = 2").Error());
+	CHECK(state.Evaluate("e(x) = 1").Error());
+	CHECK(state.Evaluate("m(x, x) = 1").Error());
+
+	state.SetVariable("a", 10);
+	state.SetVariable("b", 3);
+
+	CHECK_NUMBER(Evaluate(state, "f(2, 3)"), 7);
+	CHECK_NUMBER(Evaluate(state, "f(b, 1)"), 10);
+	CHECK_NUMBER(Evaluate(state, "g(b)"), 24);
+	CHECK_NUMBER(Evaluate(state, "h() + 1"), 8);
+	CHECK_NUMBER(Evaluate(state, "k(1)"), 11);
+	CHECK_NUMBER(Evaluate(state, "-f(2, 3)"), -7);
+	CHECK_NUMBER(Evaluate(state, "max(f(1, 1), 0)"), 2);
+
+	// Wrong number of arguments, undefined arguments
+	CHECK(state.Evaluate("f(2)").Error());
+	CHECK(state.Evaluate("f(1, 2, 3)").Error());
+	CHECK(state.Evaluate("k(q)").Error());
+
+	// Definitions do not change expressions compiled before
+	MathExpressions::CompiledExpression compiled = state.Compile("h()");
+	CHECK_NUMBER(Evaluate(state, "h() = 8"), 0);
+	CHECK_NUMBER(state.Evaluate(compiled).Get(), 7);
+	CHECK_NUMBER(Evaluate(state, "h()"), 8);
+}
+
+static void TestArguments()
+{
+	// Every argument is complete before the next one starts
+	MathExpressions::State state;
+	state.Evaluate("f(a) = a*2");
+	state.Evaluate("g(a, b) = a - b");
+	state.SetVariable("x", 3);
+
+	CHECK_NUMBER(Evaluate(state, "max(2*3, 1)"), 6);
+	CHECK_NUMBER(Evaluate(state, "min(2 + 3, 1)"), 1);
+	CHECK_NUMBER(Evaluate(state, "g(f(x), x)"), 3);
+	CHECK_NUMBER(Evaluate(state, "g(1*x, x*1)"), 0);
+}
+
+static void TestIdentities()
+{
+	// Identities with a constant left operand move the values above it down the stack
+	MathExpressions::State state;
+	state.Evaluate("f(a) = a*2");
+	state.Evaluate("g(a, b) = a - b");
+	state.Evaluate("h(a) = 1 * f(a)");
+	state.SetVariable("x", 3);
+
+	CHECK_NUMBER(Evaluate(state, "1 * f(x)"), 6);
+	CHECK_NUMBER(Evaluate(state, "-0 + f(x)"), 6);
+	CHECK_NUMBER(Evaluate(state, "1 * g(x, 1)"), 2);
+	CHECK_NUMBER(Evaluate(state, "h(x)"), 6);
+	CHECK_NUMBER(Evaluate(state, "1*g(f(x), x)"), 3);
+	CHECK_NUMBER(Evaluate(state, "1*g(1*x, 1*f(1*x))"), -3);
+
+	// Results of operations cannot be assigned to, even if an identity keeps a variable
+	CHECK(state.Evaluate("x*1 = 2").Error());
+	CHECK(state.Evaluate("1*x = 2").Error());
+	CHECK(state.Evaluate("-0 + x = 2").Error());
+	CHECK_NUMBER(Evaluate(state, "y = x*1"), 3);
+	CHECK_NUMBER(Evaluate(state, "y = 1*f(x) + y"), 9);
+	CHECK_NUMBER(Evaluate(state, "x"), 3);
+}
+
+static void TestEvaluators()
+{
+	// The interpreter, batches and native code agree on inlined calls
+	MathExpressions::State state;
+	state.Evaluate("f(x, y) = x^2 + y");
+	state.Evaluate("g(t) = f(t, t) * 2");
+	state.Evaluate("sq(v) = v*v");
+	state.Evaluate("id(v) = v");
+	state.SetVariable("b", 3);
+
+	const std::size_t rows = 700;
+	std::vector<double> x(rows), output(rows);
+	for (std::size_t i = 0; i < rows; i++)
+		x[i] = i * 0.25 - 30;
+
+	for (const char *expression : { "sq(x)", "f(x, x + 1) - g(x)", "2*sq(x + 1)", "sq(sq(x))", "id(x)", "1*sq(1*x)", "f(sqrt(x*x), b)" })
+	{
+		MathExpressions::CompiledExpression compiled = state.Compile(expression);
+		CHECK(!compiled.Error());
+		CHECK(state.EvaluateBatch(compiled, { { "x", x.data() } }, rows, output.data()));
+
+		MathExpressions::JitExpression native(compiled);
+
+		for (std::size_t i = 0; i < rows; i++)
+		{
+			MathInternals::State row;
+			row.Set("x", x[i]);
+			row.Set("b", 3);
+
+			const double expected = compiled.Evaluate(&row).Get();
+			CHECK_NUMBER(output[i], expected);
+			CHECK_NUMBER(native.Evaluate(&row).Get(), expected);
+		}
+	}
+}
+
+int main()
+{
+	TestDefinitions();
+	TestArguments();
+	TestIdentities();
+	TestEvaluators();
+
+	return TestResult();
+}
\ No newline at end of file
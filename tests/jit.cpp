@@ -0,0 +1,119 @@
+// jit.cpp : Native code against the interpreter on random expressions
+
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "check.h"
+#include "math/internals.h"
+#include "math/jit.h"
+#include "math/mathevaluator.h"
+
+static const int Expressions = 5000;
+static const int Rows = 5;
+
+// Random expression of every operator, nested up to the depth
+static std::string Generate(std::mt19937 &generator, int depth)
+{
+	const unsigned int choice = generator() % 10u;
+	if (depth == 0 || choice < 3u)
+	{
+		switch (generator() % 5u)
+		{
+		case 0u:
+			return "x";
+		case 1u:
+			return "y";
+		case 2u:
+			return "pi";
+		default:
+			return std::to_string(generator() % 20u) + "." + std::to_string(generator() % 10u);
+		}
+	}
+
+	if (choice == 3u)
+		return "-(" + Generate(generator, depth - 1) + ")";
+
+	MathInternals::Operator &op = MathInternals::g_vOperators[generator() % MathInternals::g_vOperators.size()];
+
+	// Random numbers differ between evaluations
+	if (!op.IsPure())
+		return "(" + Generate(generator, depth - 1) + ")";
+
+	if (op.GetPrecedence() == MathInternals::FunctionPrecedence)
+	{
+		if (op.GetNumOperands() == 1u)
+			return op.GetName() + "(" + Generate(generator, depth - 1) + ")";
+
+		return op.GetName() + "(" + Generate(generator, depth - 1) + ", " + Generate(generator, depth - 1) + ")";
+	}
+
+	return "(" + Generate(generator, depth - 1) + ") " + op.GetName() + " (" + Generate(generator, depth - 1) + ")";
+}
+
+// Same bits, any NaN equals any other
+static bool Identical(double a, double b)
+{
+	return std::memcmp(&a, &b, sizeof(a)) == 0 || (std::isnan(a) && std::isnan(b));
+}
+
+static void TestRandomExpressions()
+{
+	std::mt19937 generator(42u);
+	std::uniform_real_distribution<double> distribution(-5, 5);
+
+	int native = 0;
+	for (int i = 0; i < Expressions; i++)
+	{
+		const std::string expression = Generate(generator, 1 + static_cast<int>(generator() % 6u));
+		MathExpressions::CompiledExpression compiled = MathExpressions::Compile(expression);
+		if (compiled.Error())
+			continue;
+
+		MathExpressions::JitExpression jit(compiled);
+		if (jit.IsNative())
+			native++;
+
+		for (int row = 0; row < Rows; row++)
+		{
+			MathInternals::State state;
+			state.Set("x", distribution(generator));
+			state.Set("y", row == 0 ? -0.0 : distribution(generator));
+
+			MathExpressions::Result expected = compiled.Evaluate(&state);
+			MathExpressions::Result actual = jit.Evaluate(&state);
+
+			CHECK(actual.Error() == expected.Error());
+			if (!Identical(actual.Get(), expected.Get()))
+				std::fprintf(stderr, "%s: %.17g, expected %.17g\n", expression.c_str(), actual.Get(), expected.Get());
+			CHECK(Identical(actual.Get(), expected.Get()));
+		}
+	}
+
+#ifdef MATHEVALUATOR_JIT
+	// Most of the expressions are translated, the comparison would be meaningless otherwise
+	CHECK(native > Expressions / 2);
+#endif
+}
+
+static void TestInterpreted()
+{
+	MathInternals::State state;
+
+	// Undefined variables fail the same as in the interpreter
+	MathExpressions::JitExpression undefined(MathExpressions::Compile("x + 1"));
+	CHECK(undefined.Evaluate(&state).Error());
+
+	// Assignments are left to the interpreter
+	MathExpressions::JitExpression assignment(MathExpressions::Compile("z = 3"));
+	CHECK(!assignment.IsNative());
+	CHECK_NUMBER(assignment.Evaluate(&state).Get(), 3);
+}
+
+int main()
+{
+	TestRandomExpressions();
+	TestInterpreted();
+
+	return TestResult();
+}
\ No newline at end of file
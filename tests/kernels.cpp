@@ -0,0 +1,86 @@
+// kernels.cpp : Vectorized kernels of batch evaluation against the standard library
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+#include "math/mathevaluator.h"
+
+// Distance of two finite numbers in units in the last place
+static int64_t UlpDistance(double a, double b)
+{
+	int64_t x, y;
+	std::memcpy(&x, &a, sizeof(x));
+	std::memcpy(&y, &b, sizeof(y));
+
+	// Negative numbers are ordered by their magnitude
+	if (x < 0)
+		x = INT64_MIN - x;
+	if (y < 0)
+		y = INT64_MIN - y;
+
+	return x > y ? x - y : y - x;
+}
+
+static void TestTrigonometry()
+{
+	std::vector<double> x = { 0, -0.0, 1e-300, 0.5, -3, 100, 458348.94338079006, 321307.9594422229, 524288, 1e6, 1e300 };
+
+	// Arguments next to multiples of pi/2, the reduction cancels there
+	for (int k = 1; k < 333000; k += 997)
+	{
+		const double multiple = k * 1.57079632679489661923;
+		x.push_back(multiple);
+		x.push_back(std::nextafter(multiple, 0.0));
+		x.push_back(std::nextafter(multiple, INFINITY));
+		x.push_back(-multiple);
+	}
+
+	std::vector<double> output(x.size());
+
+	MathExpressions::CompiledExpression sine = MathExpressions::Compile("sin(x)");
+	CHECK(MathExpressions::EvaluateBatch(sine, { { "x", x.data() } }, x.size(), output.data()));
+	for (std::size_t i = 0; i < x.size(); i++)
+		CHECK(UlpDistance(output[i], std::sin(x[i])) <= 2);
+
+	MathExpressions::CompiledExpression cosine = MathExpressions::Compile("cos(x)");
+	CHECK(MathExpressions::EvaluateBatch(cosine, { { "x", x.data() } }, x.size(), output.data()));
+	for (std::size_t i = 0; i < x.size(); i++)
+		CHECK(UlpDistance(output[i], std::cos(x[i])) <= 2);
+}
+
+static void TestPowers()
+{
+	// Same results as the interpreter, squares included
+	std::vector<double> x = { 0, -0.0, 1, -1, 0.1, -2.5, 1e-200, 1e200, -1e200, 3, INFINITY, -INFINITY, NAN };
+	std::vector<double> y;
+	for (std::size_t i = 0; i < x.size(); i++)
+		y.push_back(i % 3 == 0 ? 0.5 : 2);
+
+	std::vector<double> output(x.size());
+
+	for (const char *expression : { "x^2", "pow(x, 2)", "x^y", "y^x", "x^-1", "x % 0.75", "mod(x, y)", "sqrt(x^2 + y^2)" })
+	{
+		MathExpressions::CompiledExpression compiled = MathExpressions::Compile(expression);
+		CHECK(MathExpressions::EvaluateBatch(compiled, { { "x", x.data() }, { "y", y.data() } }, x.size(), output.data()));
+
+		for (std::size_t i = 0; i < x.size(); i++)
+		{
+			MathInternals::State row;
+			row.Set("x", x[i]);
+			row.Set("y", y[i]);
+
+			CHECK_NUMBER(output[i], compiled.Evaluate(&row).Get());
+		}
+	}
+}
+
+int main()
+{
+	TestTrigonometry();
+	TestPowers();
+
+	return TestResult();
+}
\ No newline at end of file
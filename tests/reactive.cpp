@@ -0,0 +1,155 @@
+// reactive.cpp : Formulas recorded by a state in reactive mode and their recomputation
+
+#include "check.h"
+#include "math/internals.h"
+#include "math/mathevaluator.h"
+
+// Result of the expression, NaN on errors
+static double Evaluate(MathInternals::State &state, const char *expression)
+{
+	MathExpressions::Result res = MathExpressions::Evaluate(expression, &state);
+	return res.Error() ? NAN : res.Get();
+}
+
+static double Value(const MathInternals::State &state, const char *name)
+{
+	MathInternals::State::Slot slot = state.Find(name);
+	return slot == MathInternals::State::InvalidSlot ? NAN : state.GetValue(slot);
+}
+
+static bool HasFormula(const MathInternals::State &state, const char *name)
+{
+	MathInternals::State::Slot slot = state.Find(name);
+	return slot != MathInternals::State::InvalidSlot && state.GetFormula(slot) != nullptr;
+}
+
+static void TestChain()
+{
+	MathInternals::State state;
+	state.SetReactive(true);
+
+	CHECK_NUMBER(Evaluate(state, "x = 1"), 1);
+	CHECK_NUMBER(Evaluate(state, "y = x + 1"), 2);
+	CHECK_NUMBER(Evaluate(state, "z = y * 10"), 20);
+	CHECK(!HasFormula(state, "x"));
+	CHECK(HasFormula(state, "y"));
+
+	// Every formula sees the new values of its inputs
+	CHECK_NUMBER(Evaluate(state, "x = 4"), 4);
+	CHECK_NUMBER(Value(state, "y"), 5);
+	CHECK_NUMBER(Value(state, "z"), 50);
+
+	state.Set("x", -1);
+	CHECK_NUMBER(Value(state, "z"), 0);
+}
+
+static void TestDiamond()
+{
+	MathInternals::State state;
+	state.SetReactive(true);
+
+	Evaluate(state, "x = 3");
+	Evaluate(state, "l = x + 1");
+	Evaluate(state, "r = x * 2");
+	Evaluate(state, "d = l + r");
+	Evaluate(state, "p = d * 2 + l");
+	CHECK_NUMBER(Value(state, "d"), 10);
+	CHECK_NUMBER(Value(state, "p"), 24);
+
+	// Both sides of the diamond are computed before the formulas joining them
+	Evaluate(state, "x = 10");
+	CHECK_NUMBER(Value(state, "l"), 11);
+	CHECK_NUMBER(Value(state, "r"), 20);
+	CHECK_NUMBER(Value(state, "d"), 31);
+	CHECK_NUMBER(Value(state, "p"), 73);
+}
+
+static void TestCycles()
+{
+	MathInternals::State state;
+	state.SetReactive(true);
+
+	Evaluate(state, "x = 1");
+	Evaluate(state, "b = x + 1");
+	Evaluate(state, "a = b");
+	CHECK_NUMBER(Value(state, "a"), 2);
+
+	// Formulas cannot depend on their own variable, the old formula stays
+	CHECK(MathExpressions::Evaluate("b = a", &state).Error());
+	CHECK(MathExpressions::Evaluate("b = b + 1", &state).Error());
+	CHECK_NUMBER(Value(state, "b"), 2);
+
+	Evaluate(state, "x = 5");
+	CHECK_NUMBER(Value(state, "b"), 6);
+	CHECK_NUMBER(Value(state, "a"), 6);
+
+	// Nested assignments are not recorded, they assign plain values
+	CHECK_NUMBER(Evaluate(state, "c = (x = 2)"), 2);
+	CHECK(!HasFormula(state, "c"));
+	CHECK_NUMBER(Value(state, "a"), 3);
+}
+
+static void TestPlainValues()
+{
+	MathInternals::State state;
+	state.SetReactive(true);
+
+	Evaluate(state, "x = 1");
+	Evaluate(state, "y = x + 1");
+	Evaluate(state, "z = y * 2");
+
+	// A plain value replaces the formula, the variable no longer follows its inputs
+	CHECK_NUMBER(Evaluate(state, "y = 7"), 7);
+	CHECK(!HasFormula(state, "y"));
+	CHECK_NUMBER(Value(state, "z"), 14);
+
+	Evaluate(state, "x = 100");
+	CHECK_NUMBER(Value(state, "y"), 7);
+	CHECK_NUMBER(Value(state, "z"), 14);
+
+	// Formulas depending on the variable still do
+	Evaluate(state, "y = 8");
+	CHECK_NUMBER(Value(state, "z"), 16);
+
+	// The formula can be recorded again, depending on the same input as before
+	Evaluate(state, "y = x - 1");
+	CHECK_NUMBER(Value(state, "z"), 198);
+	Evaluate(state, "x = 2");
+	CHECK_NUMBER(Value(state, "z"), 2);
+}
+
+static void TestLeaving()
+{
+	MathInternals::State state;
+	state.SetReactive(true);
+
+	Evaluate(state, "x = 1");
+	Evaluate(state, "y = x + 1");
+
+	// Formulas are forgotten, values stay
+	state.SetReactive(false);
+	CHECK(!state.IsReactive());
+	CHECK(!HasFormula(state, "y"));
+	CHECK_NUMBER(Value(state, "y"), 2);
+
+	Evaluate(state, "x = 10");
+	CHECK_NUMBER(Value(state, "y"), 2);
+
+	// Assignments outside of reactive mode record nothing
+	Evaluate(state, "z = x * 3");
+	state.SetReactive(true);
+	CHECK(!HasFormula(state, "z"));
+	Evaluate(state, "x = 0");
+	CHECK_NUMBER(Value(state, "z"), 30);
+}
+
+int main()
+{
+	TestChain();
+	TestDiamond();
+	TestCycles();
+	TestPlainValues();
+	TestLeaving();
+
+	return TestResult();
+}
\ No newline at end of file
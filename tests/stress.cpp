@@ -0,0 +1,265 @@
+// stress.cpp : Evaluation and the state registry of the library used from several threads at once
+// Built a second time with ThreadSanitizer if the compiler supports it, see CMakeLists.txt
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "exports.h"
+#include "math/mathevaluator.h"
+
+static const int Threads = 8;
+static const int Iterations = 300;
+
+// Runs the function on every thread at once and waits for all of them
+template<typename Fn>
+static void RunThreads(Fn fn)
+{
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < Threads; thread++)
+		threads.emplace_back(fn, thread);
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+static void TestEvaluate()
+{
+	// Shared programs, random numbers and the operator table
+	MathExpressions::CompiledExpression shared = MathExpressions::Compile("sqrt(16) * 2 + max(1, 3)");
+	std::atomic<int> failures(0);
+
+	RunThreads([&](int thread)
+	{
+		for (int i = 0; i < Iterations; i++)
+		{
+			if (MathExpressions::Evaluate("2 * (3 + 4) - 1").Get() != 13)
+				failures++;
+			if (shared.Evaluate().Get() != 11)
+				failures++;
+
+			const double random = MathExpressions::Evaluate("randf(0, 1) + rand(1, 5)").Get();
+			if (!(random >= 1 && random < 6))
+				failures++;
+
+			char text[64];
+			if (evaluate("1.5 * 2", text, sizeof(text)) != 1 || std::string(text) != "3")
+				failures++;
+
+			// Cached programs are shared by the threads
+			const std::string expression = "x * " + std::to_string((thread + i) % 16) + " + 1";
+			MathExpressions::CompiledExpression cached = MathExpressions::GetExpressionCache().Get(expression);
+			MathInternals::State row;
+			row.Set("x", 2);
+			if (cached.Evaluate(&row).Get() != 2 * ((thread + i) % 16) + 1)
+				failures++;
+		}
+	});
+
+	CHECK(failures == 0);
+}
+
+static void TestCache()
+{
+	// The cache is disabled and enabled again while the other threads use it
+	MathExpressions::ExpressionCache cache(0u);
+	std::atomic<int> failures(0);
+
+	RunThreads([&](int thread)
+	{
+		for (int i = 0; i < Iterations; i++)
+		{
+			if (thread == 0)
+				cache.SetCapacity(i % 2 == 0 ? 0u : 4u);
+
+			const int term = (thread + i) % 8;
+			if (cache.Get("3 * " + std::to_string(term)).Evaluate().Get() != 3 * term)
+				failures++;
+		}
+	});
+
+	CHECK(failures == 0);
+	CHECK(cache.GetHits() + cache.GetMisses() == static_cast<std::uint64_t>(Threads * Iterations));
+	CHECK(cache.Size() <= 4u);
+}
+
+static void TestStates()
+{
+	// Every thread has a state of its own
+	std::atomic<int> failures(0);
+
+	RunThreads([&](int thread)
+	{
+		MathExpressions::State state;
+		state.Evaluate("f(a) = a * 2");
+		state.SetVariable("t", thread);
+
+		for (int i = 0; i < Iterations; i++)
+		{
+			state.Evaluate("v = f(t) + " + std::to_string(i));
+			if (state.Evaluate("v").Get() != 2 * thread + i)
+				failures++;
+		}
+	});
+
+	CHECK(failures == 0);
+}
+
+// Same bits, any NaN equals any other
+static bool Identical(double a, double b)
+{
+	return std::memcmp(&a, &b, sizeof(a)) == 0 || (std::isnan(a) && std::isnan(b));
+}
+
+// Variable names consist of letters, the digits of the index are spelled with letters
+static std::string Name(const char *prefix, int index)
+{
+	std::string name = prefix;
+	for (char digit : std::to_string(index))
+		name += static_cast<char>('q' + (digit - '0'));
+
+	return name;
+}
+
+static void TestReactive()
+{
+	// Diamonds of formulas linked into a chain, more of them than are recomputed by a single thread
+	const int diamonds = 200;
+
+	MathExpressions::State parallel;
+	MathExpressions::State serial;
+	parallel.SetThreads(4u);
+	serial.SetThreads(1u);
+
+	std::vector<std::string> script = { "a = 1" };
+	for (int i = 0; i < diamonds; i++)
+	{
+		const std::string b = Name("b", i);
+		const std::string c = Name("c", i);
+		const std::string d = Name("d", i);
+		script.push_back(b + " = a + " + std::to_string(i));
+		script.push_back(c + " = " + b + " * 2");
+		script.push_back(d + " = " + b + " / 3");
+		script.push_back(Name("f", i) + " = " + c + " - " + d + (i == 0 ? "" : " + " + Name("f", i - 1)));
+	}
+
+	for (MathExpressions::State *state : { &parallel, &serial })
+	{
+		state->SetReactive(true);
+		for (const std::string &line : script)
+			CHECK(!state->Evaluate(line).Error());
+	}
+
+	for (int i = 0; i < 20; i++)
+	{
+		// The input is given a plain value, every formula is recomputed
+		const std::string assignment = "a = " + std::to_string(i * 7 - 30) + ".25";
+		parallel.Evaluate(assignment);
+		serial.Evaluate(assignment);
+
+		for (const char *prefix : { "b", "c", "d", "f" })
+		{
+			for (int diamond = 0; diamond < diamonds; diamond++)
+			{
+				const std::string name = Name(prefix, diamond);
+				CHECK(!parallel.GetVariable(name).Error());
+				CHECK(Identical(parallel.GetVariable(name).Get(), serial.GetVariable(name).Get()));
+			}
+		}
+	}
+
+	// The last value of the input reached the end of the chain
+	CHECK_NUMBER(serial.GetVariable(Name("b", diamonds - 1)).Get(), 103.25 + diamonds - 1);
+}
+
+static void TestBatchParallel()
+{
+	// Chunks of every worker against a single thread, uneven chunks and fewer rows than threads included
+	const std::size_t rows = 10007;
+	std::vector<double> x(rows), y(rows);
+	for (std::size_t i = 0; i < rows; i++)
+	{
+		x[i] = i * 0.125 - 600;
+		y[i] = std::sin(static_cast<double>(i));
+	}
+
+	MathExpressions::CompiledExpression compiled = MathExpressions::Compile("sqrt(x^2 + y^2) * sin(x) - max(x, y) / 3");
+	const std::vector<MathExpressions::Column> columns = { { "x", x.data() }, { "y", y.data() } };
+
+	std::vector<double> expected(rows);
+	CHECK(MathExpressions::EvaluateBatch(compiled, columns, rows, expected.data()));
+
+	const MathExpressions::BatchSchedule schedules[] = { { 4u, 1000u }, { 8u, 333u }, { 3u, 1u }, { Threads, 4096u } };
+	for (const MathExpressions::BatchSchedule &schedule : schedules)
+	{
+		for (std::size_t count : { rows, static_cast<std::size_t>(1000u), static_cast<std::size_t>(5u), static_cast<std::size_t>(1u) })
+		{
+			std::vector<double> output(count, -1.0);
+			CHECK(MathExpressions::EvaluateBatchParallel(compiled, columns, count, output.data(), schedule));
+
+			for (std::size_t i = 0; i < count; i++)
+				CHECK(Identical(output[i], expected[i]));
+		}
+	}
+}
+
+static void TestRegistry()
+{
+	// States are created, evaluated and released by several threads, some of them share an id
+	MathEvaluatorExpression *handle = compile_expression("n + 1", 5);
+	CHECK(handle != nullptr);
+
+	std::atomic<int> failures(0);
+
+	RunThreads([&](int thread)
+	{
+		const int id = 1000 + thread % 4;
+
+		for (int i = 0; i < Iterations; i++)
+		{
+			int error = MATHEVALUATOR_ERROR;
+			evaluate_value_state("n = 1", 5, id, &error);
+			if (error != MATHEVALUATOR_OK)
+				failures++;
+
+			// Another thread may have released the state in between, n is then undefined
+			const double value = evaluate_expression_state(handle, id, &error);
+			if (error == MATHEVALUATOR_OK && value != 2)
+				failures++;
+
+			char text[64];
+			evaluate_state("n * 3", text, sizeof(text), id);
+
+			if (i % 7 == thread % 7)
+				release_state(id);
+		}
+	});
+
+	for (int id = 1000; id < 1004; id++)
+		release_state(id);
+
+	// A released id starts over
+	int error = MATHEVALUATOR_OK;
+	evaluate_value_state("n", 1, 1000, &error);
+	CHECK(error == MATHEVALUATOR_ERROR);
+	release_state(1000);
+
+	release_expression(handle);
+	CHECK(failures == 0);
+}
+
+int main()
+{
+	TestEvaluate();
+	TestCache();
+	TestStates();
+	TestReactive();
+	TestBatchParallel();
+	TestRegistry();
+
+	return TestResult();
+}
\ No newline at end of file